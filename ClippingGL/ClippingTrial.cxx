@@ -1,13 +1,25 @@
+#include <algorithm>
 #include <cfloat>
+#include <chrono>
 #include <cstdlib>
 #include <fstream>
+#include <future>
+#include <map>
 #include <sstream>
+#include <string>
 #include <vector>
 
 
+#include <vtkm/VectorAnalysis.h>
+#include <vtkm/cont/CellSetPermutation.h>
 #include <vtkm/cont/DataSetFieldAdd.h>
+#include <vtkm/cont/TryExecute.h>
 #include <vtkm/filter/ClipWithField.h>
 #include <vtkm/filter/ClipWithImplicitFunction.h>
+#include <vtkm/filter/Threshold.h>
+#include <vtkm/worklet/CellDeepCopy.h>
+#include <vtkm/worklet/DispatcherMapTopology.h>
+#include <vtkm/worklet/WorkletMapTopology.h>
 #include <vtkm/io/reader/VTKDataSetReader.h>
 #include <vtkm/io/writer/VTKDataSetWriter.h>
 
@@ -33,6 +45,20 @@ int buttonStates[3] = {GLUT_UP, GLUT_UP, GLUT_UP};
 bool shiftKey = false;
 int lastx = -1, lasty = -1;
 
+// Progressive rendering: while a mouse button is held the view draws the
+// decimated proxy scene, on release it goes back to the full resolution one.
+vtkm::rendering::Scene fullScene, proxyScene;
+bool haveProxy = false;
+bool showingProxy = false;
+
+void useProxy(bool proxy) {
+  proxy = proxy && haveProxy;
+  if (proxy == showingProxy)
+    return;
+  view->SetScene(proxy ? proxyScene : fullScene);
+  showingProxy = proxy;
+}
+
 void reshape(int, int) {
   // Don't allow resizing window.
   glutReshapeWindow(W, H);
@@ -40,8 +66,16 @@ void reshape(int, int) {
 
 // Render the output using simple OpenGL
 void displayCall() {
+  auto start = std::chrono::steady_clock::now();
   view->Paint();
   glutSwapBuffers();
+  glFinish();
+  std::chrono::duration<double, std::milli> frameTime =
+      std::chrono::steady_clock::now() - start;
+  std::ostringstream title;
+  title << "Clip and Iso-surfacing - " << (showingProxy ? "proxy" : "full")
+        << " " << frameTime.count() << " ms";
+  glutSetWindowTitle(title.str().c_str());
 }
 
 // Allow rotations of the camera
@@ -83,10 +117,40 @@ void mouseCall(int button, int state, int vtkmNotUsed(x), int vtkmNotUsed(y)) {
     lastx = -1;
     lasty = -1;
   }
+
+  // Interaction renders the proxy, refine once every button is released.
+  bool dragging = false;
+  for (int i = 0; i < 3; i++)
+    dragging = dragging || buttonStates[i] == GLUT_DOWN;
+  useProxy(dragging);
+  glutPostRedisplay();
 }
 
-// Compute and render the pseudocolor plot for the dataset
-int renderDataSet(vtkm::cont::DataSet &dataset) {
+// (Re)build the full resolution and proxy scenes, and show the one matching
+// the current interaction state.
+void setScenes(vtkm::cont::DataSet &dataset, vtkm::cont::DataSet *proxy) {
+  fullScene = vtkm::rendering::Scene();
+  fullScene.AddActor(vtkm::rendering::Actor(
+      dataset.GetCellSet(), dataset.GetCoordinateSystem(), dataset.GetField(0),
+      vtkm::rendering::ColorTable("rainbow")));
+  proxyScene = vtkm::rendering::Scene();
+  haveProxy = proxy != nullptr;
+  if (haveProxy)
+    proxyScene.AddActor(vtkm::rendering::Actor(
+        proxy->GetCellSet(), proxy->GetCoordinateSystem(), proxy->GetField(0),
+        vtkm::rendering::ColorTable("rainbow")));
+  if (view != nullptr) {
+    showingProxy = showingProxy && haveProxy;
+    view->SetScene(showingProxy ? proxyScene : fullScene);
+  }
+}
+
+void keyboardCall(unsigned char key, int x, int y);
+
+// Compute and render the pseudocolor plot for the dataset, proxy is drawn
+// instead while the camera is being dragged.
+int renderDataSet(vtkm::cont::DataSet &dataset,
+                  vtkm::cont::DataSet *proxy) {
   lastx = lasty = -1;
   glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH);
   glutInitWindowSize(W, H);
@@ -96,23 +160,79 @@ int renderDataSet(vtkm::cont::DataSet &dataset) {
   glutMouseFunc(mouseCall);
   glutReshapeFunc(reshape);
 
+  glutKeyboardFunc(keyboardCall);
+
   vtkm::rendering::Color bg(0.2f, 0.2f, 0.2f, 1.0f);
   vtkm::rendering::CanvasGL canvas;
   vtkm::rendering::MapperGL mapper;
 
-  vtkm::rendering::Scene scene;
-  scene.AddActor(vtkm::rendering::Actor(
-      dataset.GetCellSet(), dataset.GetCoordinateSystem(), dataset.GetField(0),
-      vtkm::rendering::ColorTable("rainbow")));
+  setScenes(dataset, proxy);
 
   // Create vtkm rendering stuff.
-  view = new vtkm::rendering::View3D(scene, mapper, canvas, bg);
+  view = new vtkm::rendering::View3D(fullScene, mapper, canvas, bg);
   view->Initialize();
   glutMainLoop();
 
   return 0;
 }
 
+// Copies every rate-th value along each axis of a structured point array.
+struct SubsamplePoints {
+  vtkm::Id3 InDims, OutDims;
+  vtkm::Id Rate;
+  vtkm::cont::DynamicArrayHandle *Output;
+
+  template <typename T, typename S>
+  void operator()(const vtkm::cont::ArrayHandle<T, S> &input) const {
+    vtkm::cont::ArrayHandle<T> sampled;
+    sampled.Allocate(this->OutDims[0] * this->OutDims[1] * this->OutDims[2]);
+    auto inPortal = input.GetPortalConstControl();
+    auto outPortal = sampled.GetPortalControl();
+    vtkm::Id out = 0;
+    for (vtkm::Id k = 0; k < this->OutDims[2]; k++)
+      for (vtkm::Id j = 0; j < this->OutDims[1]; j++)
+        for (vtkm::Id i = 0; i < this->OutDims[0]; i++) {
+          vtkm::Id3 index(std::min(i * this->Rate, this->InDims[0] - 1),
+                          std::min(j * this->Rate, this->InDims[1] - 1),
+                          std::min(k * this->Rate, this->InDims[2] - 1));
+          outPortal.Set(out++, inPortal.Get((index[2] * this->InDims[1] + index[1]) *
+                                            this->InDims[0] + index[0]));
+        }
+    *this->Output = vtkm::cont::DynamicArrayHandle(sampled);
+  }
+};
+
+// Builds a lower resolution copy of a 3D structured input, keeping every
+// rate-th point (and the last one) along each axis. Returns false for
+// unstructured inputs, which get no proxy.
+bool subsampleStructured(vtkm::cont::DataSet &input, char *variable,
+                         vtkm::Id rate, vtkm::cont::DataSet &output) {
+  if (rate < 2 || !input.GetCellSet(0).IsSameType(vtkm::cont::CellSetStructured<3>()))
+    return false;
+  vtkm::cont::CellSetStructured<3> cellSet =
+      input.GetCellSet(0).Cast<vtkm::cont::CellSetStructured<3>>();
+  SubsamplePoints subsample;
+  subsample.InDims = cellSet.GetPointDimensions();
+  subsample.Rate = rate;
+  for (int axis = 0; axis < 3; axis++)
+    subsample.OutDims[axis] = (subsample.InDims[axis] + rate - 2) / rate + 1;
+
+  vtkm::cont::DynamicArrayHandle points, field;
+  subsample.Output = &points;
+  input.GetCoordinateSystem().GetData().CastAndCall(subsample);
+  subsample.Output = &field;
+  input.GetPointField(variable).GetData().CastAndCall(subsample);
+
+  vtkm::cont::CellSetStructured<3> sampledCells(cellSet.GetName());
+  sampledCells.SetPointDimensions(subsample.OutDims);
+  output = vtkm::cont::DataSet();
+  output.AddCellSet(sampledCells);
+  output.AddCoordinateSystem(vtkm::cont::CoordinateSystem(
+      input.GetCoordinateSystem().GetName(), points));
+  output.AddField(vtkm::cont::Field(variable, vtkm::cont::Field::ASSOC_POINTS, field));
+  return true;
+}
+
 class PopulateIndices : public vtkm::worklet::WorkletMapField {
 public:
   typedef void ControlSignature(FieldIn<> input, FieldOut<> output);
@@ -124,14 +244,21 @@ public:
   }
 };
 
-int performTrivialIsoVolume(vtkm::cont::DataSet &input, char *variable,
-                            vtkm::filter::Result &result,
-                            vtkm::Float32 isoValMin) {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
+bool hasCellField(const vtkm::cont::DataSet &dataset, const std::string &name) {
+  for (vtkm::Id i = 0; i < dataset.GetNumberOfFields(); i++)
+    if (dataset.GetField(i).GetName() == name &&
+        dataset.GetField(i).GetAssociation() == vtkm::cont::Field::ASSOC_CELL_SET)
+      return true;
+  return false;
+}
 
-  // Add CellIds as cell centerd field.
+// Adds the cellIds field unless the dataset already carries one, so that
+// re-clipping a subset keeps the ids of the originally loaded cells.
+void addCellIds(vtkm::cont::DataSet &input) {
+  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
+  std::string cellIdsVar("cellIds");
+  if (hasCellField(input, cellIdsVar))
+    return;
   vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
 
   std::cout << "Number of Cells : " << numCells << std::endl;
@@ -145,9 +272,115 @@ int performTrivialIsoVolume(vtkm::cont::DataSet &input, char *variable,
   indicesImplicitType.ReleaseResources();
 
   // Add derived field to dataset.
-  std::string cellIdsVar("cellIds");
   vtkm::cont::DataSetFieldAdd datasetFieldAdder;
   datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
+}
+
+// Per-cell maximum of the clip variable. Cached on the loaded dataset as
+// "cellMax" so a new isovalue can discard cells that cannot reach it without
+// looking at the point field again.
+class CellMax : public vtkm::worklet::WorkletMapPointToCell {
+public:
+  typedef void ControlSignature(CellSetIn, FieldInPoint<ScalarAll>, FieldOut<>);
+  typedef void ExecutionSignature(PointCount, _2, _3);
+
+  template <typename FieldVecType>
+  VTKM_EXEC void operator()(vtkm::IdComponent pointCount,
+                            const FieldVecType &fieldData,
+                            vtkm::Float32 &cellMax) const {
+    cellMax = static_cast<vtkm::Float32>(fieldData[0]);
+    for (vtkm::IdComponent i = 1; i < pointCount; ++i)
+      cellMax = vtkm::Max(cellMax, static_cast<vtkm::Float32>(fieldData[i]));
+  }
+};
+
+void addCellMax(vtkm::cont::DataSet &input, char *variable) {
+  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
+  std::string cellMaxVar("cellMax");
+  if (hasCellField(input, cellMaxVar))
+    return;
+  vtkm::cont::ArrayHandle<vtkm::Float32> cellMax;
+  vtkm::worklet::DispatcherMapTopology<CellMax, DeviceAdapterTag>().Invoke(
+      input.GetCellSet(0), input.GetPointField(variable).GetData(), cellMax);
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  datasetFieldAdder.AddCellField(input, cellMaxVar, cellMax);
+}
+
+using ExplicitType =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetExplicit<>>;
+using ExplicitSingleType =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetSingleType<>>;
+using Structured3d =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetStructured<3>>;
+
+template <typename CellSetType> struct DeepCopy {
+  const CellSetType &m_input;
+  vtkm::cont::CellSetExplicit<> &m_output;
+
+  DeepCopy(CellSetType &input, vtkm::cont::CellSetExplicit<> &output)
+      : m_input(input), m_output(output) {}
+
+  template <typename Device> bool operator()(Device device) {
+    m_output = vtkm::worklet::CellDeepCopy::Run(m_input, Device());
+    return true;
+  }
+};
+
+// Threshold output is a permutation the clip filter cannot take, copy it into
+// an explicit cell set.
+void castToExplicit(vtkm::cont::DataSet &input, vtkm::cont::DataSet &output) {
+  vtkm::cont::DynamicCellSet cellSet = input.GetCellSet();
+  vtkm::cont::CellSetExplicit<> explicitCellSet;
+  if (cellSet.IsSameType(ExplicitType())) {
+    ExplicitType explicitType = cellSet.Cast<ExplicitType>();
+    DeepCopy<ExplicitType> functor(explicitType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else if (cellSet.IsSameType(ExplicitSingleType())) {
+    ExplicitSingleType explicitType = cellSet.Cast<ExplicitSingleType>();
+    DeepCopy<ExplicitSingleType> functor(explicitType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else if (cellSet.IsSameType(Structured3d())) {
+    Structured3d structuredType = cellSet.Cast<Structured3d>();
+    DeepCopy<Structured3d> functor(structuredType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else {
+    output = input;
+    return;
+  }
+  output = vtkm::cont::DataSet();
+  output.AddCellSet(explicitCellSet);
+  for (vtkm::Id ind = 0; ind < input.GetNumberOfCoordinateSystems(); ind++)
+    output.AddCoordinateSystem(input.GetCoordinateSystem(ind));
+  for (vtkm::Id ind = 0; ind < input.GetNumberOfFields(); ind++)
+    output.AddField(input.GetField(ind));
+}
+
+// Cells whose maximum is below isoValue produce nothing in an isovolume, so
+// only the remaining ones are handed to the clip.
+void selectCandidateCells(vtkm::cont::DataSet &input, char *variable,
+                          vtkm::Float32 isoValue, vtkm::cont::DataSet &subset) {
+  addCellIds(input);
+  addCellMax(input, variable);
+  vtkm::filter::Threshold threshold;
+  threshold.SetLowerThreshold(isoValue);
+  threshold.SetUpperThreshold(FLT_MAX);
+  vtkm::filter::Result candidates =
+      threshold.Execute(input, std::string("cellMax"));
+  threshold.MapFieldOntoOutput(candidates, input.GetPointField(variable));
+  threshold.MapFieldOntoOutput(candidates, input.GetCellField("cellIds"));
+  castToExplicit(candidates.GetDataSet(), subset);
+}
+
+int performTrivialIsoVolume(vtkm::cont::DataSet &input, char *variable,
+                            vtkm::filter::Result &result,
+                            vtkm::Float32 isoValMin) {
+  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
+  using DeviceAlgorithm =
+      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
+
+  // Add CellIds as cell centerd field.
+  addCellIds(input);
+  std::string cellIdsVar("cellIds");
 
   vtkm::filter::ClipWithField clip;
   clip.SetClipValue(isoValMin);
@@ -174,21 +407,8 @@ int performMinMaxIsoVolume(vtkm::cont::DataSet &input, char *variable,
   vtkm::cont::DataSetFieldAdd datasetFieldAdder;
 
   // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-
-  std::cout << "Number of Cells : " << numCells << std::endl;
-
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
-
-  // Add derived field to dataset.
+  addCellIds(input);
   std::string cellIdsVar("cellIds");
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
 
   vtkm::filter::Result firstResult, secondResult;
   vtkm::filter::ClipWithField firstClip, secondClip;
@@ -307,22 +527,8 @@ int performTrivialClip(vtkm::cont::DataSet &input, char* variable,
       typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
 
   // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-
-  std::cout << "Number of Cells : " << numCells << std::endl;
-
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
-
-  // Add derived field to dataset.
+  addCellIds(input);
   std::string cellIdsVar("cellIds");
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
 
   vtkm::filter::ClipWithImplicitFunction clip;
   clip.SetImplicitFunction(vtkm::cont::make_ImplicitFunctionHandle(vtkm::Plane(origin, normal)));
@@ -332,48 +538,42 @@ int performTrivialClip(vtkm::cont::DataSet &input, char* variable,
   return 0;
 }
 
+// Numeric parameters are positional; anything of the form --key[=value] is
+// collected into options.
 int parseParameters(int argc, char **argv,
                     char **filename, char **variable,
-                    std::vector<float>& params)
+                    std::vector<float>& params,
+                    std::map<std::string, std::string>& options)
 {
   if (argc < 3)
     std::cerr << "Invalid number of arguments" << std::endl;
   *filename = argv[1];
   *variable = argv[2];
-  int numParams = argc - 3;
-  for(int i = 0; i < numParams; i++)
+  for(int i = 3; i < argc; i++)
   {
-    params.push_back(atof(argv[i+3]));
+    std::string arg(argv[i]);
+    if (arg.compare(0, 2, "--") == 0)
+    {
+      size_t split = arg.find('=');
+      options[arg.substr(2, split - 2)] =
+          (split == std::string::npos) ? "" : arg.substr(split + 1);
+      continue;
+    }
+    params.push_back(atof(argv[i]));
   }
+  return 0;
 }
 
-int main(int argc, char **argv) {
-
-  glutInit(&argc, argv);
-  if (argc < 3)
-  {
-    std::cerr << "Invalid num of arguments " << std::endl;
-    exit(0);
-  }
-  char *filename, *variable;
-  std::vector<float> params;
-  parseParameters(argc, argv, &filename, &variable, params);
-
-  // Read dataset
-  vtkm::io::reader::VTKDataSetReader reader(filename);
-  vtkm::cont::DataSet input = reader.ReadDataSet();
-
-  // Query original dataset
-  std::cout << "Original number of Cells : "
-            << input.GetCellSet(0).GetNumberOfCells() << std::endl;
-
-  // Apply filter begins here.
-  vtkm::filter::Result result;
-
+// Runs the operation selected by params[0] on input.
+int applyOperation(vtkm::cont::DataSet &input, char *variable,
+                   std::vector<float>& params, vtkm::filter::Result &result)
+{
   int option = params.size() == 0 ? 0: (int)params[0];
   float isoValMin = FLT_MIN, isoValMax = FLT_MAX;
   vtkm::Vec<vtkm::Float32, 3> origin;
   vtkm::Vec<vtkm::Float32, 3> normal;
+  // Isovolumes only clip the cells that can reach the isovalue.
+  vtkm::cont::DataSet subset;
 
   switch (option) {
   case 1 :
@@ -386,20 +586,155 @@ int main(int argc, char **argv) {
     // Case for simple IsoVolume.
     isoValMax = (params.size() > 1) ? params[1] : 3.0f;
     std::cout << "Executing trivial IsoVolume." << std::endl;
-    performTrivialIsoVolume(input, variable, result, isoValMax);
+    selectCandidateCells(input, variable, isoValMax, subset);
+    if (subset.GetCellSet(0).GetNumberOfCells() == 0)
+      return 1;
+    performTrivialIsoVolume(subset, variable, result, isoValMax);
     break;
   case 5 :
     // Case of Min-Max IsoVolume.
     isoValMin = params[1];
     isoValMax = params[2];
     std::cout << "Executing Min-Max IsoVolume." << std::endl;
-    performMinMaxIsoVolume(input, variable, result, isoValMin, isoValMax);
+    selectCandidateCells(input, variable, isoValMin, subset);
+    if (subset.GetCellSet(0).GetNumberOfCells() == 0)
+      return 1;
+    performMinMaxIsoVolume(subset, variable, result, isoValMin, isoValMax);
     break;
   default:
     std::cout << "Suitable option/params not provided" << std::endl;
-    exit(1);
-    break;
+    return 1;
   }
+  return 0;
+}
+
+// Live parameter changes from the keyboard. The loaded input, with its cellIds
+// and cellMax fields, and the subsampled proxy input stay in memory; a change
+// only re-runs the clip on a background thread and the finished meshes are
+// swapped into the scenes on the next poll.
+//   +/-  move the isovalue (min isovalue for option 5) or the plane origin
+//   >/<  move the max isovalue of option 5
+struct LiveClip {
+  vtkm::cont::DataSet input, sampled;
+  bool haveSampled = false;
+  char *variable = nullptr;
+  std::vector<float> params;
+  vtkm::Float32 fieldStep = 0.f, planeStep = 0.f;
+} live;
+
+struct ReclipOutput {
+  vtkm::cont::DataSet clipped, proxy;
+  bool valid = false, haveProxy = false;
+  double seconds = 0.;
+};
+
+std::future<ReclipOutput> reclipTask;
+bool reclipQueued = false;
+
+ReclipOutput reclip(std::vector<float> params) {
+  auto start = std::chrono::steady_clock::now();
+  ReclipOutput output;
+  vtkm::filter::Result result, proxyResult;
+  output.valid = applyOperation(live.input, live.variable, params, result) == 0;
+  if (output.valid)
+    output.clipped = result.GetDataSet();
+  output.haveProxy =
+      output.valid && live.haveSampled &&
+      applyOperation(live.sampled, live.variable, params, proxyResult) == 0;
+  if (output.haveProxy)
+    output.proxy = proxyResult.GetDataSet();
+  output.seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  return output;
+}
+
+void startReclip();
+
+void pollReclip(int) {
+  if (!reclipTask.valid())
+    return;
+  if (reclipTask.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    glutTimerFunc(30, pollReclip, 0);
+    return;
+  }
+  ReclipOutput output = reclipTask.get();
+  if (output.valid) {
+    setScenes(output.clipped, output.haveProxy ? &output.proxy : nullptr);
+    std::cout << "Re-clipped to " << output.clipped.GetCellSet(0).GetNumberOfCells()
+              << " cells in " << output.seconds << " s" << std::endl;
+  } else {
+    std::cout << "Nothing left after re-clip, keeping the previous mesh" << std::endl;
+  }
+  glutPostRedisplay();
+  // Coalesce key presses that came in while clipping.
+  if (reclipQueued) {
+    reclipQueued = false;
+    startReclip();
+  }
+}
+
+void startReclip() {
+  if (reclipTask.valid()) {
+    reclipQueued = true;
+    return;
+  }
+  reclipTask = std::async(std::launch::async, reclip, live.params);
+  glutTimerFunc(30, pollReclip, 0);
+}
+
+void keyboardCall(unsigned char key, int vtkmNotUsed(x), int vtkmNotUsed(y)) {
+  int option = live.params.size() == 0 ? 0 : (int)live.params[0];
+  vtkm::Float32 direction = (key == '+' || key == '=' || key == '>') ? 1.f : -1.f;
+  if (key != '+' && key != '=' && key != '-' && key != '>' && key != '<')
+    return;
+
+  if (option == 1 && (key == '+' || key == '=' || key == '-')) {
+    vtkm::Vec<vtkm::Float32, 3> normal =
+        vtkm::make_Vec(live.params[4], live.params[5], live.params[6]);
+    vtkm::Normalize(normal);
+    for (int i = 0; i < 3; i++)
+      live.params[i + 1] += direction * live.planeStep * normal[i];
+    std::cout << "Plane origin : " << live.params[1] << ", " << live.params[2]
+              << ", " << live.params[3] << std::endl;
+  } else if ((option == 2 || option == 5) && key != '>' && key != '<') {
+    if (live.params.size() < 2)
+      live.params.push_back(3.0f);
+    live.params[1] += direction * live.fieldStep;
+    std::cout << "Isovalue : " << live.params[1] << std::endl;
+  } else if (option == 5) {
+    live.params[2] += direction * live.fieldStep;
+    std::cout << "Max isovalue : " << live.params[2] << std::endl;
+  } else {
+    return;
+  }
+  startReclip();
+}
+
+int main(int argc, char **argv) {
+
+  glutInit(&argc, argv);
+  if (argc < 3)
+  {
+    std::cerr << "Invalid num of arguments " << std::endl;
+    exit(0);
+  }
+  char *filename, *variable;
+  std::vector<float> params;
+  std::map<std::string, std::string> options;
+  parseParameters(argc, argv, &filename, &variable, params, options);
+
+  // Read dataset
+  vtkm::io::reader::VTKDataSetReader reader(filename);
+  vtkm::cont::DataSet input = reader.ReadDataSet();
+
+  // Query original dataset
+  std::cout << "Original number of Cells : "
+            << input.GetCellSet(0).GetNumberOfCells() << std::endl;
+
+  // Apply filter begins here.
+  vtkm::filter::Result result;
+  if (applyOperation(input, variable, params, result))
+    exit(1);
 
   // Retrieve resultant dataset
   vtkm::cont::DataSet clipped = result.GetDataSet();
@@ -411,8 +746,38 @@ int main(int argc, char **argv) {
             << std::endl;
 
   processForSplitCells(clipped);
+
+  // Decimated proxy for interaction: the same operation on a subsampled
+  // input, every 4th point by default, --lod=1 turns it off.
+  vtkm::Id lodRate = options.count("lod") ? atoi(options["lod"].c_str()) : 4;
+  vtkm::cont::DataSet sampled, proxy;
+  vtkm::filter::Result proxyResult;
+  bool haveProxyData = subsampleStructured(input, variable, lodRate, sampled) &&
+                       applyOperation(sampled, variable, params, proxyResult) == 0;
+  if (haveProxyData) {
+    proxy = proxyResult.GetDataSet();
+    std::cout << "Proxy number of Cells : "
+              << proxy.GetCellSet(0).GetNumberOfCells() << std::endl;
+  }
+
+  // Keep the inputs around for live re-clipping, steps are 1% of the field
+  // range and of the bounding box diagonal.
+  live.input = input;
+  live.sampled = sampled;
+  live.haveSampled = haveProxyData;
+  live.variable = variable;
+  live.params = params;
+  vtkm::Range fieldRange =
+      input.GetPointField(variable).GetRange().GetPortalConstControl().Get(0);
+  live.fieldStep = static_cast<vtkm::Float32>(fieldRange.Length() / 100.0);
+  vtkm::Bounds bounds = input.GetCoordinateSystem().GetBounds();
+  live.planeStep = static_cast<vtkm::Float32>(
+      vtkm::Sqrt(bounds.X.Length() * bounds.X.Length() +
+                 bounds.Y.Length() * bounds.Y.Length() +
+                 bounds.Z.Length() * bounds.Z.Length()) / 100.0);
+
   // Render for verification if the dataset looks like VisIt.
-  renderDataSet(clipped);
+  renderDataSet(clipped, haveProxyData ? &proxy : nullptr);
 
   return 0;
 }
@@ -0,0 +1,176 @@
+#ifndef BATCHED_CLIP_H
+#define BATCHED_CLIP_H
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <vtkm/Bounds.h>
+#include <vtkm/ListTag.h>
+#include <vtkm/Math.h>
+#include <vtkm/Types.h>
+#include <vtkm/VectorAnalysis.h>
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/DeviceAdapterAlgorithm.h>
+#include <vtkm/cont/ErrorBadValue.h>
+#include <vtkm/worklet/DispatcherMapField.h>
+#include <vtkm/worklet/WorkletMapField.h>
+
+// Clipping by several implicit functions at once. All functions are
+// evaluated at every point in a single pass over the coordinates, giving one
+// signed distance field per function, and the clips then run on those fields
+// with ClipWithField at 0. As with ClipWithImplicitFunction, the side where a
+// function is positive is kept: the side of a plane its normal points to, the
+// outside of a sphere or a box.
+
+struct ClipFunction {
+  enum Kinds { PLANE = 0, SPHERE = 1, BOX = 2 };
+
+  vtkm::Int32 Kind;
+  // Plane origin and normal, sphere center, box minimum and maximum corner.
+  vtkm::Vec<vtkm::Float32, 3> A;
+  vtkm::Vec<vtkm::Float32, 3> B;
+  vtkm::Float32 Radius;
+
+  VTKM_EXEC_CONT vtkm::Float32 Value(const vtkm::Vec<vtkm::Float32, 3> &point) const {
+    if (this->Kind == PLANE)
+      return vtkm::dot(point - this->A, this->B);
+    if (this->Kind == SPHERE)
+      return vtkm::MagnitudeSquared(point - this->A) - this->Radius * this->Radius;
+    // Box: minus the distance to the nearest face inside, the distance to the
+    // box outside.
+    vtkm::Float32 inside = -vtkm::Infinity32();
+    vtkm::Float32 outside = 0;
+    for (vtkm::IdComponent i = 0; i < 3; i++) {
+      vtkm::Float32 distance = vtkm::Max(this->A[i] - point[i], point[i] - this->B[i]);
+      inside = vtkm::Max(inside, distance);
+      if (distance > 0)
+        outside += distance * distance;
+    }
+    return inside <= 0 ? inside : vtkm::Sqrt(outside);
+  }
+};
+
+using ClipFunctionList = vtkm::ListTagBase<ClipFunction>;
+
+// Parses "plane:ox,oy,oz,nx,ny,nz", "sphere:cx,cy,cz,r" and
+// "box:x0,y0,z0,x1,y1,z1" separated by ';'. "axes" stands for the three
+// planes through the center of bounds, normal to x, y and z.
+inline std::vector<ClipFunction> ParseClipFunctions(const std::string &spec,
+                                                    const vtkm::Bounds &bounds) {
+  std::vector<ClipFunction> functions;
+  std::istringstream items(spec);
+  std::string item;
+  while (std::getline(items, item, ';')) {
+    if (item.empty())
+      continue;
+    if (item == "axes") {
+      vtkm::Vec<vtkm::Float64, 3> center = bounds.Center();
+      for (int axis = 0; axis < 3; axis++) {
+        ClipFunction plane = {ClipFunction::PLANE,
+                              vtkm::Vec<vtkm::Float32, 3>(center), {0, 0, 0}, 0};
+        plane.B[axis] = 1;
+        functions.push_back(plane);
+      }
+      continue;
+    }
+    size_t colon = item.find(':');
+    std::string kind = item.substr(0, colon);
+    std::vector<vtkm::Float32> values;
+    std::istringstream numbers(colon == std::string::npos ? "" : item.substr(colon + 1));
+    std::string number;
+    while (std::getline(numbers, number, ','))
+      values.push_back(static_cast<vtkm::Float32>(atof(number.c_str())));
+
+    ClipFunction function = {ClipFunction::PLANE, {0, 0, 0}, {0, 0, 0}, 0};
+    if ((kind == "plane" || kind == "box") && values.size() == 6) {
+      function.Kind = (kind == "plane") ? ClipFunction::PLANE : ClipFunction::BOX;
+      function.A = vtkm::make_Vec(values[0], values[1], values[2]);
+      function.B = vtkm::make_Vec(values[3], values[4], values[5]);
+    } else if (kind == "sphere" && values.size() == 4) {
+      function.Kind = ClipFunction::SPHERE;
+      function.A = vtkm::make_Vec(values[0], values[1], values[2]);
+      function.Radius = values[3];
+    } else {
+      throw vtkm::cont::ErrorBadValue("Cannot parse clip function " + item);
+    }
+    functions.push_back(function);
+  }
+  return functions;
+}
+
+// Writes the value of function f at point i to distances[f * numPoints + i],
+// so that the field of every function is a contiguous range.
+class EvaluateClipFunctionsWorklet : public vtkm::worklet::WorkletMapField {
+public:
+  typedef void ControlSignature(FieldIn<Vec3> point,
+                                WholeArrayIn<ClipFunctionList> functions,
+                                WholeArrayOut<Scalar> distances);
+  typedef void ExecutionSignature(_1, _2, _3, WorkIndex);
+
+  VTKM_CONT EvaluateClipFunctionsWorklet(vtkm::Id numPoints)
+      : NumPoints(numPoints) {}
+
+  template <typename PointType, typename FunctionPortal, typename DistancePortal>
+  VTKM_EXEC void operator()(const PointType &point,
+                            const FunctionPortal &functions,
+                            const DistancePortal &distances,
+                            vtkm::Id index) const {
+    vtkm::Vec<vtkm::Float32, 3> position(static_cast<vtkm::Float32>(point[0]),
+                                         static_cast<vtkm::Float32>(point[1]),
+                                         static_cast<vtkm::Float32>(point[2]));
+    for (vtkm::Id f = 0; f < functions.GetNumberOfValues(); f++)
+      distances.Set(f * this->NumPoints + index, functions.Get(f).Value(position));
+  }
+
+private:
+  vtkm::Id NumPoints;
+};
+
+template <typename Device> struct EvaluateOnCoordinates {
+  const vtkm::cont::ArrayHandle<ClipFunction> &m_functions;
+  vtkm::cont::ArrayHandle<vtkm::Float32> &m_distances;
+
+  EvaluateOnCoordinates(const vtkm::cont::ArrayHandle<ClipFunction> &functions,
+                        vtkm::cont::ArrayHandle<vtkm::Float32> &distances)
+      : m_functions(functions), m_distances(distances) {}
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &points) const {
+    vtkm::Id numPoints = points.GetNumberOfValues();
+    m_distances.Allocate(numPoints * m_functions.GetNumberOfValues());
+    vtkm::worklet::DispatcherMapField<EvaluateClipFunctionsWorklet, Device>(
+        EvaluateClipFunctionsWorklet(numPoints))
+        .Invoke(points, m_functions, m_distances);
+  }
+};
+
+// Evaluates all Functions at the points of Input in one pass and splits the
+// result into one Float32 point field per function, on whichever device the
+// runtime tracker allows.
+struct EvaluateClipFunctions {
+  vtkm::cont::DataSet Input;
+  std::vector<ClipFunction> Functions;
+  std::vector<vtkm::cont::ArrayHandle<vtkm::Float32>> Distances;
+
+  template <typename Device> bool operator()(Device) {
+    using DeviceAlgorithm = vtkm::cont::DeviceAdapterAlgorithm<Device>;
+    vtkm::cont::ArrayHandle<ClipFunction> functions =
+        vtkm::cont::make_ArrayHandle(this->Functions);
+    vtkm::cont::ArrayHandle<vtkm::Float32> distances;
+    this->Input.GetCoordinateSystem().GetData().CastAndCall(
+        EvaluateOnCoordinates<Device>(functions, distances));
+
+    vtkm::Id numPoints = this->Input.GetCoordinateSystem().GetData().GetNumberOfValues();
+    this->Distances.assign(this->Functions.size(),
+                           vtkm::cont::ArrayHandle<vtkm::Float32>());
+    for (size_t f = 0; f < this->Functions.size(); f++)
+      DeviceAlgorithm::CopySubRange(distances, static_cast<vtkm::Id>(f) * numPoints,
+                                    numPoints, this->Distances[f]);
+    return true;
+  }
+};
+
+#endif
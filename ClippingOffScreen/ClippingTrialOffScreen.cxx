@@ -1,15 +1,36 @@
+#include <algorithm>
+#include <atomic>
 #include <cfloat>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <future>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
 #include <sstream>
+#include <string>
+#include <thread>
 #include <vector>
 
+#ifndef VTKM_DEVICE_ADAPTER
+#define VTKM_DEVICE_ADAPTER VTKM_DEVICE_ADAPTER_SERIAL
+#endif
+
+#include <vtkm/BinaryOperators.h>
+#include <vtkm/cont/CellSetSingleType.h>
 #include <vtkm/cont/DataSetFieldAdd.h>
+#include <vtkm/cont/TryExecute.h>
 #include <vtkm/cont/Timer.h>
 #include <vtkm/filter/ClipWithField.h>
 #include <vtkm/filter/ClipWithImplicitFunction.h>
+#include <vtkm/filter/ExternalFaces.h>
 #include <vtkm/filter/MarchingCubes.h>
-#include <vtkm/io/reader/VTKDataSetReader.h>
+#include <vtkm/io/ErrorIO.h>
 #include <vtkm/io/writer/VTKDataSetWriter.h>
 
 // For offscreen rendering
@@ -19,11 +40,46 @@
 #include <vtkm/rendering/Scene.h>
 #include <vtkm/rendering/View3D.h>
 
-#define VTKM_DEVICE_ADAPTER VTKM_DEVICE_ADAPTER_SERIAL
+#include "ArrayPool.h"
+#include "BatchedClip.h"
+#include "BinaryDataSetWriter.h"
+#include "BoundedQueue.h"
+#include "CellVolume.h"
+#include "DeviceSelection.h"
+#include "ImageWriter.h"
+#include "LazyClipResult.h"
+#include "LocalSocket.h"
+#include "MinMaxIsoVolume.h"
+#include "MultiBlock.h"
+#include "SharedMemoryDataSet.h"
+#include "SyntheticDataSet.h"
+
+// Write the dataset, legacy binary by default so that large clip outputs do
+// not spend longer in the writer than in the clip. VisIt reads either flavour.
+int writeDataSet(vtkm::cont::DataSet &dataset, const std::string &filename,
+                 bool binary) {
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> writeTimer;
+  try {
+    if (binary) {
+      BinaryDataSetWriter writer(filename);
+      writer.WriteDataSet(dataset, static_cast<vtkm::Id>(0));
+    } else {
+      vtkm::io::writer::VTKDataSetWriter writer(filename);
+      writer.WriteDataSet(dataset, static_cast<vtkm::Id>(0));
+    }
+  } catch (vtkm::cont::Error &error) {
+    std::cerr << "Failed to write " << filename << " : " << error.GetMessage()
+              << std::endl;
+    return 1;
+  }
+  std::cout << "Time taken to write " << filename << " : "
+            << writeTimer.GetElapsedTime() << std::endl;
+  return 0;
+}
 
 // Compute and render the pseudocolor plot for the dataset
 int renderAndWriteDataSet(vtkm::cont::DataSet &dataset,
-                          char* variable) {
+                          char* variable, bool binary = true) {
 
   vtkm::rendering::CanvasRayTracer canvas;
   vtkm::rendering::MapperRayTracer mapper;
@@ -54,11 +110,94 @@ int renderAndWriteDataSet(vtkm::cont::DataSet &dataset,
     view.SaveAs(filename.str());
   }
 
-  vtkm::io::writer::VTKDataSetWriter writer("vtkmwritten.vtk");
-  writer.WriteDataSet(dataset, static_cast<vtkm::Id>(0));
+  writeDataSet(dataset, "vtkmwritten.vtk", binary);
   return 0;
 }
 
+// Renders the same camera gallery as renderAndWriteDataSet, but all views at
+// once. The ray tracer only ever hits the boundary of the clipped volume, so
+// the external faces are extracted a single time and every view builds its
+// acceleration structure over that surface instead of over the full mesh.
+// Views are spread over numWorkers threads, each with its own canvas, and the
+// images are compressed and written while the remaining views render.
+int renderViewsBatch(vtkm::cont::DataSet &dataset, char* variable,
+                     int numViews, int numWorkers) {
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> facesTimer;
+  vtkm::filter::ExternalFaces externalFaces;
+  vtkm::filter::Result faces = externalFaces.Execute(dataset);
+  externalFaces.MapFieldOntoOutput(faces, dataset.GetPointField(variable));
+  vtkm::cont::DataSet surface = faces.GetDataSet();
+  std::cout << "External faces : " << surface.GetCellSet(0).GetNumberOfCells()
+            << " in " << facesTimer.GetElapsedTime() << std::endl;
+
+  vtkm::rendering::Scene scene;
+  scene.AddActor(vtkm::rendering::Actor(surface.GetCellSet(),
+                                        surface.GetCoordinateSystem(),
+                                        surface.GetPointField(variable),
+                                        vtkm::rendering::ColorTable("temperature")));
+
+  // Same camera walk as the sequential gallery, where each view starts from
+  // the previous one.
+  std::vector<vtkm::rendering::Camera> cameras;
+  {
+    vtkm::rendering::CanvasRayTracer canvas;
+    vtkm::rendering::MapperRayTracer mapper;
+    vtkm::rendering::View3D view(scene, mapper, canvas);
+    vtkm::rendering::Camera camera = view.GetCamera();
+    for (int i = 0; i < numViews; i++) {
+      camera.Azimuth(i*45.0);
+      camera.Elevation(i*45.0);
+      cameras.push_back(camera);
+    }
+  }
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> renderTimer;
+  std::atomic<int> nextView(0);
+  std::mutex writesMutex;
+  std::vector<std::future<std::string>> writes;
+  auto renderWorker = [&]() {
+    vtkm::rendering::CanvasRayTracer canvas;
+    vtkm::rendering::MapperRayTracer mapper;
+    vtkm::rendering::View3D view(scene, mapper, canvas);
+    view.Initialize();
+    view.SetBackgroundColor(vtkm::rendering::Color(1,1,1,1));
+    view.SetForegroundColor(vtkm::rendering::Color(0,0,0,1));
+    for (int i = nextView++; i < numViews; i = nextView++) {
+      view.SetCamera(cameras[i]);
+      view.Paint();
+      std::ostringstream basename;
+      basename << "clipped" << i;
+      std::string name = basename.str();
+      auto rgb = std::make_shared<std::vector<unsigned char>>(CanvasToRGB(canvas));
+      vtkm::Id width = canvas.GetWidth(), height = canvas.GetHeight();
+      std::lock_guard<std::mutex> lock(writesMutex);
+      writes.push_back(std::async(std::launch::async,
+                                  [=]() { return WriteImage(name, width,
+                                                            height, *rgb); }));
+    }
+  };
+
+  std::vector<std::future<void>> workers;
+  for (int i = 0; i < numWorkers; i++)
+    workers.push_back(std::async(std::launch::async, renderWorker));
+  for (auto& worker : workers)
+    worker.get();
+  std::cout << "Time taken to render " << numViews << " views : "
+            << renderTimer.GetElapsedTime() << std::endl;
+  int failed = 0;
+  for (auto& write : writes) {
+    try {
+      std::cout << "Wrote " << write.get() << std::endl;
+    } catch (vtkm::cont::Error &error) {
+      std::cerr << error.GetMessage() << std::endl;
+      failed = 1;
+    }
+  }
+  std::cout << "Time taken to render and write : "
+            << renderTimer.GetElapsedTime() << std::endl;
+  return failed;
+}
+
 class PopulateIndices : public vtkm::worklet::WorkletMapField {
 public:
   typedef void ControlSignature(FieldIn<> input, FieldOut<> output);
@@ -70,148 +209,117 @@ public:
   }
 };
 
+struct PopulateCellIds {
+  vtkm::cont::ArrayHandle<vtkm::Id> CellIds;
+  vtkm::Id NumCells;
+  std::string Device;
+
+  template <typename Device> bool operator()(Device device) {
+    vtkm::cont::ArrayHandleIndex indicesImplicitType(this->NumCells);
+    vtkm::worklet::DispatcherMapField<PopulateIndices, Device>().Invoke(
+        indicesImplicitType, this->CellIds);
+    this->Device = DeviceName(device);
+    return true;
+  }
+};
+
+// Add CellIds as cell centerd field, on whichever device the runtime tracker
+// allows. Datasets that already carry the field keep their ids; synthetic ones
+// come with implicit ids.
+void addCellIds(vtkm::cont::DataSet &input) {
+  std::string cellIdsVar("cellIds");
+  for (vtkm::Id i = 0; i < input.GetNumberOfFields(); i++)
+    if (input.GetField(i).GetName() == cellIdsVar)
+      return;
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> cellIdsTimer;
+  PopulateCellIds functor;
+  functor.NumCells = input.GetCellSet(0).GetNumberOfCells();
+  vtkm::cont::TryExecute(functor);
+
+  // Add derived field to dataset.
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  datasetFieldAdder.AddCellField(input, cellIdsVar, functor.CellIds);
+  std::cout << "Time taken for cellIds (" << functor.Device << ") : "
+            << cellIdsTimer.GetElapsedTime() << std::endl;
+}
+
 int performTrivialIsoVolume(vtkm::cont::DataSet &input, char *variable,
                             vtkm::filter::Result &result,
                             vtkm::Float32 isoValMin) {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
-
   // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
-
-  // Add derived field to dataset.
+  addCellIds(input);
   std::string cellIdsVar("cellIds");
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
 
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> stageTimer;
   vtkm::filter::ClipWithField clip;
   clip.SetClipValue(isoValMin);
-  result = clip.Execute(input, std::string(variable));
-  clip.MapFieldOntoOutput(result, input.GetPointField(variable));
-  clip.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar));
+  ImplicitFieldPolicy policy;
+  result = clip.Execute(input, std::string(variable), policy);
+  std::cout << "Time taken for clip : " << stageTimer.GetElapsedTime() << std::endl;
+  stageTimer.Reset();
+  clip.MapFieldOntoOutput(result, input.GetPointField(variable), policy);
+  clip.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar), policy);
+  std::cout << "Time taken for field mapping : " << stageTimer.GetElapsedTime()
+            << std::endl;
   return 0;
 }
 
-class NegateFieldValues : public vtkm::worklet::WorkletMapField {
-public:
-  typedef void ControlSignature(FieldInOut<> val);
-  typedef void ExecutionSignature(_1);
-
-  template <typename T> VTKM_EXEC void operator()(T &val) const { val = -val; }
-};
-
 int performMinMaxIsoVolume(vtkm::cont::DataSet &input, char *variable,
                            vtkm::filter::Result &result,
                            vtkm::Float32 isoValMin, vtkm::Float32 isoValMax) {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-
   // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
-
-  // Add derived field to dataset.
-  std::string cellIdsVar("cellIds");
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
-
-  vtkm::filter::Result firstResult, secondResult;
-  vtkm::filter::ClipWithField firstClip, secondClip;
-
-  // Apply clip with Min.
-  firstClip.SetClipValue(isoValMin);
-  firstResult = firstClip.Execute(input, std::string(variable));
-  firstClip.MapFieldOntoOutput(firstResult, input.GetPointField(variable));
-  firstClip.MapFieldOntoOutput(firstResult, input.GetCellField(cellIdsVar));
-
-  // Output of first clip.
-  vtkm::cont::DataSet& firstClipped = firstResult.GetDataSet();
-
-  vtkm::cont::Field field;
-  vtkm::cont::DynamicArrayHandle fieldData;
-  /*vtkm::cont::ArrayHandle<vtkm::Float32> newFieldData;
-  std::string newVariable(variable);
-
-  // Negate field to apply clip once again.
-  field  = firstClipped.GetPointField(variable);
-  fieldData = field.GetData();
-  newFieldData.Allocate(fieldData.GetNumberOfValues());
-  fieldData.CopyTo(newFieldData);
-  vtkm::worklet::DispatcherMapField<NegateFieldValues, DeviceAdapterTag>()
-      .Invoke(newFieldData);
-  // Add derived field to dataset.
-  datasetFieldAdder.AddPointField(firstClipped, newVariable, newFieldData);*/
-  field  = firstClipped.GetPointField(variable);
-  fieldData = field.GetData();
-  vtkm::worklet::DispatcherMapField<NegateFieldValues, DeviceAdapterTag>()
-      .Invoke(fieldData);
-
-  // Apply clip with Max.
-  secondClip.SetClipValue(-isoValMax);
-  secondResult = secondClip.Execute(firstClipped, std::string(variable));
-  secondClip.MapFieldOntoOutput(secondResult,
-                                firstClipped.GetPointField(variable));
-  secondClip.MapFieldOntoOutput(secondResult,
-                                firstClipped.GetCellField(cellIdsVar));
-
-  vtkm::cont::DataSet& secondClipped = secondResult.GetDataSet();
-  // Negate field to apply clip once again.
-  /*field  = secondClipped.GetPointField(variable);
-  fieldData = field.GetData();
-  newFieldData.Allocate(fieldData.GetNumberOfValues());
-  fieldData.CopyTo(newFieldData);
-  vtkm::worklet::DispatcherMapField<NegateFieldValues, DeviceAdapterTag>()
-      .Invoke(newFieldData);
-  // Add derived field to dataset.
-  datasetFieldAdder.AddPointField(secondClipped, newVariable, newFieldData);*/
-  field  = secondClipped.GetPointField(variable);
-  fieldData = field.GetData();
-  vtkm::worklet::DispatcherMapField<NegateFieldValues, DeviceAdapterTag>()
-      .Invoke(fieldData);
-
-  // Result of the Min-Max IsoVolume operation.
-  result = secondResult;
-  return 0;
+  addCellIds(input);
+  return MinMaxIsoVolume(input, std::string(variable), std::string("cellIds"),
+                         isoValMin, isoValMax, result);
 }
 
-int processForSplitCells(vtkm::cont::DataSet &dataSet) {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
+// Counts how many output cells every input cell was split into, and how many
+// input cells share each split count.
+struct CountSplitCells {
+  vtkm::cont::ArrayHandle<vtkm::Id> CellIds;
+  vtkm::cont::ArrayHandle<vtkm::Id> UniqueCellIds;
+  vtkm::cont::ArrayHandle<vtkm::Id> CountCellIds;
+  vtkm::cont::ArrayHandle<vtkm::Id> UniqueCounts;
+  vtkm::cont::ArrayHandle<vtkm::Id> LikeCountCells;
+
+  template <typename Device> bool operator()(Device) {
+    using DeviceAlgorithm = vtkm::cont::DeviceAdapterAlgorithm<Device>;
+    vtkm::Id numCellIds = this->CellIds.GetNumberOfValues();
+    vtkm::cont::ArrayHandleConstant<vtkm::Id> toReduce(1, numCellIds);
+    // Sort
+    DeviceAlgorithm::Sort(this->CellIds);
+    // Extract unique, these were the cells that appear after the
+    // IsoVolume operation.
+    // Reduce by Key
+    DeviceAlgorithm::ReduceByKey(this->CellIds, toReduce, this->UniqueCellIds,
+                                 this->CountCellIds, vtkm::Add());
 
+    //For binning
+    vtkm::cont::ArrayHandle<vtkm::Id> sortedCounts;
+    DeviceAlgorithm::Copy(this->CountCellIds, sortedCounts);
+    DeviceAlgorithm::Sort(sortedCounts);
+    vtkm::cont::ArrayHandleConstant<vtkm::Id> toReduceCounts(
+        1, sortedCounts.GetNumberOfValues());
+    DeviceAlgorithm::ReduceByKey(sortedCounts, toReduceCounts,
+                                 this->UniqueCounts, this->LikeCountCells,
+                                 vtkm::Add());
+    return true;
+  }
+};
+
+int processForSplitCells(vtkm::cont::DataSet &dataSet) {
   std::string cellIdsVar("cellIds");
   // Get the array handle for the cellIds variable
   vtkm::cont::DynamicArrayHandle fieldData =
       dataSet.GetCellField(cellIdsVar).GetData();
-  vtkm::Id numCellIds = fieldData.GetNumberOfValues();
-  vtkm::cont::ArrayHandle<vtkm::Id> fieldDataHandle;
-  fieldDataHandle.Allocate(numCellIds);
-  fieldData.CopyTo(fieldDataHandle);
-  vtkm::cont::ArrayHandleConstant<vtkm::Id> toReduce(1, numCellIds);
-  // Sort
-  DeviceAlgorithm::Sort(fieldDataHandle);
-  // Extract unique, these were the cells that appear after the
-  // IsoVolume operation.
-  vtkm::cont::ArrayHandle<vtkm::Id> uniqueCellIds;
-  vtkm::cont::ArrayHandle<vtkm::Id> countCellIds;
-  // Reduce by Key
-  DeviceAlgorithm::ReduceByKey(fieldDataHandle, toReduce, uniqueCellIds,
-                               countCellIds, vtkm::Add());
+  CountSplitCells functor;
+  functor.CellIds =
+      ArrayPool::Global().Acquire<vtkm::Id>(fieldData.GetNumberOfValues());
+  fieldData.CopyTo(functor.CellIds);
+  vtkm::cont::TryExecute(functor);
+  vtkm::cont::ArrayHandle<vtkm::Id> uniqueCellIds = functor.UniqueCellIds;
+  vtkm::cont::ArrayHandle<vtkm::Id> countCellIds = functor.CountCellIds;
   vtkm::Id uniqueKeys = uniqueCellIds.GetNumberOfValues();
   std::cout << "Number of unique Cell IDs : " << uniqueKeys << std::endl;
   auto keyPortal = uniqueCellIds.GetPortalConstControl();
@@ -223,15 +331,8 @@ int processForSplitCells(vtkm::cont::DataSet &dataSet) {
     vtkmfile << keyPortal.Get(i) << ", " << countPortal.Get(i) << ", VTK-m" << std::endl;
   vtkmfile.close();
 
-  //For binning
-  DeviceAlgorithm::Sort(countCellIds);
-  vtkm::cont::ArrayHandleConstant<vtkm::Id> toReduceCounts(1, uniqueKeys);
-
-  vtkm::cont::ArrayHandle<vtkm::Id> uniqueCounts;
-  vtkm::cont::ArrayHandle<vtkm::Id> likeCountCells;
-
-  DeviceAlgorithm::ReduceByKey(countCellIds, toReduceCounts, uniqueCounts,
-                               likeCountCells, vtkm::Add());
+  vtkm::cont::ArrayHandle<vtkm::Id> uniqueCounts = functor.UniqueCounts;
+  vtkm::cont::ArrayHandle<vtkm::Id> likeCountCells = functor.LikeCountCells;
 
   auto splitCountPortal = uniqueCounts.GetPortalConstControl();
   auto likeCountPortal = likeCountCells.GetPortalConstControl();
@@ -240,6 +341,8 @@ int processForSplitCells(vtkm::cont::DataSet &dataSet) {
   for(int i = 0; i < uniqueKeys; i++)
     vtkmfile << splitCountPortal.Get(i) << ", " << likeCountPortal.Get(i) << std::endl;
   vtkmfile.close();
+  ArrayPool::Global().Release(functor.CellIds);
+  return 0;
 }
 
 int performTrivialClip(vtkm::cont::DataSet &input, char* variable,
@@ -247,76 +350,1103 @@ int performTrivialClip(vtkm::cont::DataSet &input, char* variable,
                        vtkm::Vec<vtkm::Float32, 3> origin,
                        vtkm::Vec<vtkm::Float32, 3> normal)
 {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
-
   // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
-
-  // Add derived field to dataset.
+  addCellIds(input);
   std::string cellIdsVar("cellIds");
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
 
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> stageTimer;
   vtkm::filter::ClipWithImplicitFunction clip;
   clip.SetImplicitFunction(vtkm::cont::make_ImplicitFunctionHandle(vtkm::Plane(origin, normal)));
-  result = clip.Execute(input);
-  clip.MapFieldOntoOutput(result, input.GetPointField(variable));
-  clip.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar));
+  ImplicitFieldPolicy policy;
+  result = clip.Execute(input, policy);
+  std::cout << "Time taken for clip : " << stageTimer.GetElapsedTime() << std::endl;
+  stageTimer.Reset();
+  clip.MapFieldOntoOutput(result, input.GetPointField(variable), policy);
+  clip.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar), policy);
+  std::cout << "Time taken for field mapping : " << stageTimer.GetElapsedTime()
+            << std::endl;
+  return 0;
+}
+
+// The isovolume above isoValue clipped by the plane of performTrivialClip,
+// with cellIds added once. It is the chain of performTrivialIsoVolume and
+// performTrivialClip, so it keeps the same cells: a single ClipWithField on
+// min(variable - isoValue, planeDistance) would cut the edges that switch
+// criterion by interpolating between the two, and flatten the crease where
+// the isosurface meets the plane. The intermediate output only carries the
+// fields the plane clip maps on.
+int performIsoVolumeAndPlane(vtkm::cont::DataSet &input, char *variable,
+                             vtkm::filter::Result &result,
+                             vtkm::Float32 isoValue,
+                             vtkm::Vec<vtkm::Float32, 3> origin,
+                             vtkm::Vec<vtkm::Float32, 3> normal) {
+  // Add CellIds as cell centerd field.
+  addCellIds(input);
+  std::string cellIdsVar("cellIds");
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> stageTimer;
+  ImplicitFieldPolicy policy;
+  vtkm::filter::ClipWithField isoClip;
+  isoClip.SetClipValue(isoValue);
+  vtkm::filter::Result isoVolume = isoClip.Execute(input, std::string(variable),
+                                                   policy);
+  isoClip.MapFieldOntoOutput(isoVolume, input.GetPointField(variable), policy);
+  isoClip.MapFieldOntoOutput(isoVolume, input.GetCellField(cellIdsVar), policy);
+  std::cout << "Time taken for isovolume clip : "
+            << stageTimer.GetElapsedTime() << std::endl;
+
+  stageTimer.Reset();
+  vtkm::cont::DataSet &kept = isoVolume.GetDataSet();
+  vtkm::filter::ClipWithImplicitFunction planeClip;
+  planeClip.SetImplicitFunction(
+      vtkm::cont::make_ImplicitFunctionHandle(vtkm::Plane(origin, normal)));
+  result = planeClip.Execute(kept, policy);
+  planeClip.MapFieldOntoOutput(result, kept.GetPointField(variable), policy);
+  planeClip.MapFieldOntoOutput(result, kept.GetCellField(cellIdsVar), policy);
+  std::cout << "Time taken for plane clip : " << stageTimer.GetElapsedTime()
+            << std::endl;
   return 0;
 }
 
+// Range of the field over the corners of every cell.
+class CellFieldRange : public vtkm::worklet::WorkletMapPointToCell {
+public:
+  typedef void ControlSignature(CellSetIn, FieldInPoint<>, FieldOutCell<>,
+                                FieldOutCell<>);
+  typedef void ExecutionSignature(PointCount, _2, _3, _4);
+
+  template <typename FieldVecType>
+  VTKM_EXEC void operator()(vtkm::IdComponent pointCount,
+                            const FieldVecType &fieldData,
+                            vtkm::Float64 &low, vtkm::Float64 &high) const {
+    low = high = static_cast<vtkm::Float64>(fieldData[0]);
+    for (vtkm::IdComponent i = 1; i < pointCount; i++) {
+      vtkm::Float64 value = static_cast<vtkm::Float64>(fieldData[i]);
+      low = vtkm::Min(low, value);
+      high = vtkm::Max(high, value);
+    }
+  }
+};
+
+// Number of cells each isovalue cuts. MarchingCubes counts a corner as
+// inside when it is above the isovalue, so a cell is cut when
+// low <= isovalue < high. The cell ranges come from one pass over the cells
+// whatever the number of isovalues; sorted by either end, every isovalue
+// then takes two binary searches: the cells starting at or below it, less
+// those that also end at or below it.
+struct CountContourCells {
+  vtkm::cont::DynamicCellSet CellSet;
+  vtkm::cont::DynamicArrayHandleBase<ScalarFieldTypeList,
+                                     ImplicitFieldStorageList> FieldData;
+  std::vector<vtkm::Float64> IsoValues;
+  std::vector<vtkm::Id> CutCells;
+
+  template <typename Device> bool operator()(Device) {
+    using DeviceAlgorithm = vtkm::cont::DeviceAdapterAlgorithm<Device>;
+    vtkm::cont::ArrayHandle<vtkm::Float64> low, high;
+    vtkm::worklet::DispatcherMapTopology<CellFieldRange, Device>().Invoke(
+        this->CellSet, this->FieldData, low, high);
+    DeviceAlgorithm::Sort(low);
+    DeviceAlgorithm::Sort(high);
+
+    vtkm::cont::ArrayHandle<vtkm::Float64> isoValues =
+        vtkm::cont::make_ArrayHandle(this->IsoValues);
+    vtkm::cont::ArrayHandle<vtkm::Id> startBelow, endBelow;
+    DeviceAlgorithm::UpperBounds(low, isoValues, startBelow);
+    DeviceAlgorithm::UpperBounds(high, isoValues, endBelow);
+    auto startPortal = startBelow.GetPortalConstControl();
+    auto endPortal = endBelow.GetPortalConstControl();
+    this->CutCells.resize(this->IsoValues.size());
+    for (size_t i = 0; i < this->IsoValues.size(); i++)
+      this->CutCells[i] = startPortal.Get(static_cast<vtkm::Id>(i)) -
+                          endPortal.Get(static_cast<vtkm::Id>(i));
+    return true;
+  }
+};
+
+// Smallest and largest value of a point field, by two reductions on the
+// device.
+template <typename Device> struct ReduceFieldRange {
+  vtkm::Float64 &m_low;
+  vtkm::Float64 &m_high;
+
+  ReduceFieldRange(vtkm::Float64 &low, vtkm::Float64 &high)
+      : m_low(low), m_high(high) {}
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &field) const {
+    using DeviceAlgorithm = vtkm::cont::DeviceAdapterAlgorithm<Device>;
+    m_low = static_cast<vtkm::Float64>(DeviceAlgorithm::Reduce(
+        field, std::numeric_limits<T>::max(), vtkm::Minimum()));
+    m_high = static_cast<vtkm::Float64>(DeviceAlgorithm::Reduce(
+        field, std::numeric_limits<T>::lowest(), vtkm::Maximum()));
+  }
+};
+
+struct FieldRange {
+  vtkm::cont::DynamicArrayHandleBase<ScalarFieldTypeList,
+                                     ImplicitFieldStorageList> FieldData;
+  vtkm::Float64 Low;
+  vtkm::Float64 High;
+
+  template <typename Device> bool operator()(Device) {
+    this->FieldData.CastAndCall(ReduceFieldRange<Device>(this->Low, this->High));
+    return true;
+  }
+};
+
+// All the isosurfaces in one MarchingCubes run. The values are sorted, and
+// those that cut no cell are left out: the ones outside the range of the
+// field, or with cellCounts those CountContourCells finds no cell for, at the
+// cost of two sorts over the cells. MarchingCubes itself still classifies
+// every cell against each remaining value; SetMergeDuplicatePoints merges the
+// points that the cells around an edge generate on it. When no value is left
+// the output is the input points without cells. The cellIds provenance is
+// only added and mapped when asked for.
 int performIsoSurface(vtkm::cont::DataSet &input, char *variable,
                       vtkm::filter::Result &result,
-                      std::vector<double>& isoValues)
+                      std::vector<double>& isoValues, bool provenance,
+                      bool cellCounts)
 {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-
-  // Add CellIds as cell centerd field.
-  vtkm::Id numCells = input.GetCellSet(0).GetNumberOfCells();
-  vtkm::cont::ArrayHandle<vtkm::Id> cellIds;
-  cellIds.Allocate(numCells);
-  cellIds.PrepareForInPlace(DeviceAdapterTag());
-  vtkm::cont::ArrayHandleIndex indicesImplicitType(numCells);
-  vtkm::worklet::DispatcherMapField<PopulateIndices, DeviceAdapterTag>().Invoke(
-      indicesImplicitType, cellIds);
-  indicesImplicitType.ReleaseResources();
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> stageTimer;
+  std::sort(isoValues.begin(), isoValues.end());
+  isoValues.erase(std::unique(isoValues.begin(), isoValues.end()),
+                  isoValues.end());
+  std::vector<double> cutting;
+  if (cellCounts) {
+    CountContourCells count;
+    count.CellSet = input.GetCellSet(0);
+    count.FieldData = input.GetPointField(variable).GetData().ResetTypeAndStorageLists(
+        ScalarFieldTypeList(), ImplicitFieldStorageList());
+    count.IsoValues = isoValues;
+    vtkm::cont::TryExecute(count);
+    for (size_t i = 0; i < count.IsoValues.size(); i++) {
+      std::cout << "Isovalue " << count.IsoValues[i] << " : "
+                << count.CutCells[i] << " cells" << std::endl;
+      if (count.CutCells[i] > 0)
+        cutting.push_back(count.IsoValues[i]);
+    }
+    std::cout << "Time taken for cell ranges : " << stageTimer.GetElapsedTime()
+              << std::endl;
+  } else {
+    // A cell is cut when low <= isovalue < high, so no cell is cut outside
+    // [min, max) of the field.
+    FieldRange range;
+    range.FieldData = input.GetPointField(variable).GetData().ResetTypeAndStorageLists(
+        ScalarFieldTypeList(), ImplicitFieldStorageList());
+    vtkm::cont::TryExecute(range);
+    for (double isoValue : isoValues)
+      if (range.Low <= isoValue && isoValue < range.High)
+        cutting.push_back(isoValue);
+    std::cout << "Time taken for field range : " << stageTimer.GetElapsedTime()
+              << std::endl;
+  }
 
-  // Add derived field to dataset.
   std::string cellIdsVar("cellIds");
-  datasetFieldAdder.AddCellField(input, cellIdsVar, cellIds);
+  if (cutting.empty()) {
+    std::cout << "Contours : 0, triangles : 0" << std::endl;
+    vtkm::cont::DataSet empty;
+    empty.AddCoordinateSystem(input.GetCoordinateSystem());
+    vtkm::cont::CellSetSingleType<> noCells("cells");
+    noCells.Fill(input.GetCoordinateSystem().GetData().GetNumberOfValues(),
+                 vtkm::CELL_SHAPE_TRIANGLE, 3,
+                 vtkm::cont::ArrayHandle<vtkm::Id>());
+    empty.AddCellSet(noCells);
+    empty.AddField(input.GetPointField(variable));
+    if (provenance)
+      vtkm::cont::DataSetFieldAdd().AddCellField(
+          empty, cellIdsVar, vtkm::cont::ArrayHandle<vtkm::Id>());
+    result = vtkm::filter::Result(empty);
+    return 0;
+  }
+
+  if (provenance)
+    // Add CellIds as cell centerd field.
+    addCellIds(input);
 
+  stageTimer.Reset();
   vtkm::filter::MarchingCubes marchingCubes;
-  marchingCubes.SetIsoValues(isoValues);
-  result = marchingCubes.Execute(input, variable);
-  marchingCubes.MapFieldOntoOutput(result, input.GetPointField(variable));
-  marchingCubes.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar));
+  marchingCubes.SetIsoValues(cutting);
+  marchingCubes.SetMergeDuplicatePoints(true);
+  ImplicitFieldPolicy policy;
+  result = marchingCubes.Execute(input, std::string(variable), policy);
+  vtkm::Float64 elapsed = stageTimer.GetElapsedTime();
+  vtkm::Id triangles = result.GetDataSet().GetCellSet(0).GetNumberOfCells();
+  std::cout << "Contours : " << cutting.size() << ", triangles : " << triangles
+            << ", time : " << elapsed;
+  if (elapsed > 0)
+    std::cout << ", triangles/s : " << triangles / elapsed;
+  std::cout << std::endl;
+
+  marchingCubes.MapFieldOntoOutput(result, input.GetPointField(variable), policy);
+  if (provenance)
+    marchingCubes.MapFieldOntoOutput(result, input.GetCellField(cellIdsVar), policy);
+  return 0;
 }
 
+// Runs the operation selected by params[0] on input: the plane clip (1), the
+// isovolume (2), the min-max isovolume (3), the isosurface (4) or the
+// isovolume clipped by a plane (6, "6 <iso> ox oy oz nx ny nz"). The
+// isosurface also takes --provenance and --sweep from options, the isovolume
+// clipped by a plane --compare. Returns 1, leaving result untouched, when the
+// option or its parameters are missing.
+int performOption(vtkm::cont::DataSet &input, char *variable,
+                  std::vector<float> &params,
+                  std::map<std::string, std::string> &options,
+                  vtkm::filter::Result &result) {
+  int option = params.size() == 0 ? 0: (int)params[0];
+  float isoValMin = FLT_MIN, isoValMax = FLT_MAX;
+  std::vector<double> isoValues;
+  vtkm::Vec<vtkm::Float32, 3> origin;
+  vtkm::Vec<vtkm::Float32, 3> normal;
+
+  switch (option) {
+  case 1 :
+    // Case of Implicit Function.
+    if (params.size() < 7)
+      return 1;
+    origin = vtkm::make_Vec(params[1], params[2], params[3]);
+    normal = vtkm::make_Vec(params[4], params[5], params[6]);
+    return performTrivialClip(input, variable, result, origin, normal);
+  case 2 :
+    // Case for simple IsoVolume.
+    isoValMax = (params.size() > 1) ? params[1] : 3.0f;
+    std::cout << "Executing trivial IsoVolume." << std::endl;
+    return performTrivialIsoVolume(input, variable, result, isoValMax);
+  case 3 :
+    // Case of Min-Max IsoVolume.
+    if (params.size() < 3)
+      return 1;
+    isoValMin = params[1];
+    isoValMax = params[2];
+    std::cout << "Executing Min-Max IsoVolume." << std::endl;
+    return performMinMaxIsoVolume(input, variable, result, isoValMin, isoValMax);
+  case 4 :
+    // Case of Iso Surface.
+    if (params.size() < 2)
+      return 1;
+    for(size_t i = 1; i < params.size(); i++)
+      isoValues.push_back(params[i]);
+    std::cout << "Executing Iso-Surface." << std::endl;
+    // --sweep also contours the first 1, 2, ... of the isovalues, for the
+    // triangle rate at every contour count, and prints the cells each
+    // isovalue cuts.
+    if (options.count("sweep"))
+      for (size_t count = 1; count < isoValues.size(); count++) {
+        std::vector<double> first(isoValues.begin(), isoValues.begin() + count);
+        vtkm::filter::Result sweepResult;
+        performIsoSurface(input, variable, sweepResult, first, false, false);
+      }
+    return performIsoSurface(input, variable, result, isoValues,
+                             options.count("provenance") > 0,
+                             options.count("sweep") > 0);
+  case 6 :
+    // Case of IsoVolume clipped by a plane.
+    if (params.size() < 8)
+      return 1;
+    origin = vtkm::make_Vec(params[2], params[3], params[4]);
+    normal = vtkm::make_Vec(params[5], params[6], params[7]);
+    // --compare also runs performTrivialIsoVolume and performTrivialClip
+    // first, on a copy of input, and prints the cells and volume of both
+    // outputs next to their times.
+    if (options.count("compare")) {
+      vtkm::cont::DataSet chainInput = input;
+      vtkm::filter::Result isoResult, chainResult;
+      vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> chainTimer;
+      performTrivialIsoVolume(chainInput, variable, isoResult, params[1]);
+      performTrivialClip(isoResult.GetDataSet(), variable, chainResult, origin,
+                         normal);
+      vtkm::Float64 chainTime = chainTimer.GetElapsedTime();
+      std::cout << "Chained IsoVolume and plane clip : "
+                << chainResult.GetDataSet().GetCellSet(0).GetNumberOfCells()
+                << " cells, volume : " << DataSetVolume(chainResult.GetDataSet())
+                << ", time : " << chainTime << std::endl;
+    }
+    std::cout << "Executing IsoVolume and plane clip." << std::endl;
+    {
+      vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> singleTimer;
+      int status = performIsoVolumeAndPlane(input, variable, result, params[1],
+                                            origin, normal);
+      vtkm::Float64 singleTime = singleTimer.GetElapsedTime();
+      if (options.count("compare"))
+        std::cout << "IsoVolume and plane clip : "
+                  << result.GetDataSet().GetCellSet(0).GetNumberOfCells()
+                  << " cells, volume : " << DataSetVolume(result.GetDataSet())
+                  << ", time : " << singleTime << std::endl;
+      return status;
+    }
+  default:
+    return 1;
+  }
+}
+
+using BlockOperation =
+    std::function<int(vtkm::cont::DataSet &, vtkm::filter::Result &)>;
+
+// Applies operation to every block and returns the outputs in block order.
+// Blocks of at least largeBlockCells cells go first, one at a time, so that
+// each gets the whole device for its own parallel loops. The others are
+// spread over numWorkers threads, largest first, each clipping its block with
+// whatever share of the device it gets.
+int performMultiBlock(std::vector<vtkm::cont::DataSet> &blocks,
+                      const BlockOperation &operation,
+                      int numWorkers, vtkm::Id largeBlockCells,
+                      std::vector<vtkm::cont::DataSet> &outputs) {
+  const size_t numBlocks = blocks.size();
+  std::vector<vtkm::Id> inputCells(numBlocks);
+  std::vector<size_t> order(numBlocks);
+  vtkm::Id totalCells = 0;
+  for (size_t i = 0; i < numBlocks; i++) {
+    inputCells[i] = blocks[i].GetCellSet(0).GetNumberOfCells();
+    totalCells += inputCells[i];
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return inputCells[a] > inputCells[b];
+  });
+
+  outputs.assign(numBlocks, vtkm::cont::DataSet());
+  std::vector<vtkm::Float64> seconds(numBlocks, 0);
+  auto clipBlock = [&](size_t block) {
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> blockTimer;
+    vtkm::filter::Result result;
+    operation(blocks[block], result);
+    outputs[block] = result.GetDataSet();
+    seconds[block] = blockTimer.GetElapsedTime();
+  };
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
+  size_t numLarge = 0;
+  while (numLarge < numBlocks && inputCells[order[numLarge]] >= largeBlockCells)
+    clipBlock(order[numLarge++]);
+
+  std::atomic<size_t> nextBlock(numLarge);
+  auto clipWorker = [&]() {
+    for (size_t i = nextBlock++; i < numBlocks; i = nextBlock++)
+      clipBlock(order[i]);
+  };
+  std::vector<std::future<void>> workers;
+  for (int i = 0; i < numWorkers; i++)
+    workers.push_back(std::async(std::launch::async, clipWorker));
+  for (auto& worker : workers)
+    worker.get();
+  vtkm::Float64 elapsed = timer.GetElapsedTime();
+
+  vtkm::Id totalOutput = 0;
+  for (size_t i = 0; i < numBlocks; i++) {
+    vtkm::Id outputCells = outputs[i].GetCellSet(0).GetNumberOfCells();
+    totalOutput += outputCells;
+    std::cout << "Block " << i << " : " << inputCells[i] << " -> "
+              << outputCells << " cells in " << seconds[i]
+              << (inputCells[i] >= largeBlockCells ? " (large)" : "")
+              << std::endl;
+  }
+  std::cout << "Time taken for " << numBlocks << " blocks : " << elapsed
+            << std::endl;
+  std::cout << "Filtered number of Cells : " << totalOutput << std::endl;
+  std::cout << "Throughput : " << totalCells / elapsed << " cells/s"
+            << std::endl;
+  return 0;
+}
+
+// The per block operation for the plane clip (1) and the isovolume (2) of
+// the switch in main, empty for the other options.
+BlockOperation makeBlockOperation(char *variable, std::vector<float> &params) {
+  int option = params.size() == 0 ? 0 : (int)params[0];
+  BlockOperation operation;
+  if (option == 1 && params.size() > 6) {
+    vtkm::Vec<vtkm::Float32, 3> origin =
+        vtkm::make_Vec(params[1], params[2], params[3]);
+    vtkm::Vec<vtkm::Float32, 3> normal =
+        vtkm::make_Vec(params[4], params[5], params[6]);
+    operation = [=](vtkm::cont::DataSet &block, vtkm::filter::Result &result) {
+      return performTrivialClip(block, variable, result, origin, normal);
+    };
+  } else if (option == 2) {
+    float isoValMax = (params.size() > 1) ? params[1] : 3.0f;
+    operation = [=](vtkm::cont::DataSet &block, vtkm::filter::Result &result) {
+      return performTrivialIsoVolume(block, variable, result, isoValMax);
+    };
+  }
+  return operation;
+}
+
+int numberOfWorkers(std::map<std::string, std::string> &options) {
+  int workers = options.count("workers") ? atoi(options["workers"].c_str())
+                                         : std::thread::hardware_concurrency();
+  return std::max(1, workers);
+}
+
+// --output=<name>.vtk writes <name><suffix>.vtk.
+std::string outputName(std::map<std::string, std::string> &options,
+                       const std::string &suffix) {
+  std::string output = options["output"];
+  size_t dot = output.rfind('.');
+  std::string stem = (dot == std::string::npos) ? output : output.substr(0, dot);
+  std::string extension = (dot == std::string::npos) ? ".vtk" : output.substr(dot);
+  return stem + suffix + extension;
+}
+
+// Multi-block counterpart of the single dataset switch in main.
+int clipBlocks(std::vector<vtkm::cont::DataSet> &blocks, char *variable,
+               std::vector<float> &params,
+               std::map<std::string, std::string> &options) {
+  BlockOperation operation = makeBlockOperation(variable, params);
+  if (!operation) {
+    std::cout << "Multi-block inputs support the plane clip (1) and the "
+              << "isovolume (2)" << std::endl;
+    return 1;
+  }
+
+  vtkm::Id totalCells = 0;
+  for (auto &block : blocks)
+    totalCells += block.GetCellSet(0).GetNumberOfCells();
+  int workers = numberOfWorkers(options);
+  // By default a block is large when it holds more than a worker's share.
+  vtkm::Id largeBlockCells = options.count("large-block")
+                                 ? atoll(options["large-block"].c_str())
+                                 : totalCells / workers + 1;
+
+  std::vector<vtkm::cont::DataSet> outputs;
+  performMultiBlock(blocks, operation, workers, largeBlockCells, outputs);
+
+  // Every block goes to its own <name>.<block>.vtk.
+  if (options.count("output")) {
+    for (size_t i = 0; i < outputs.size(); i++)
+      writeDataSet(outputs[i], outputName(options, "." + std::to_string(i)),
+                   options.count("ascii") == 0);
+  }
+  ArrayPool::Global().PrintStatistics(std::cout);
+  return 0;
+}
+
+// Clips input by every implicit function of --functions (see
+// ParseClipFunctions, three axis planes through the center by default). The
+// functions are evaluated in a single pass over the points and the cellIds
+// are set up once. Every function gives its own output, written to
+// <name>.<function>.vtk; with --intersect they are applied one after the
+// other instead, each clip working on what the previous ones kept, and the
+// single output is the region on the positive side of all of them.
+int clipFunctions(vtkm::cont::DataSet &input, char *variable,
+                  std::map<std::string, std::string> &options) {
+  std::vector<ClipFunction> functions;
+  try {
+    functions = ParseClipFunctions(
+        options.count("functions") ? options["functions"] : "axes",
+        input.GetCoordinateSystem().GetBounds());
+  } catch (vtkm::cont::ErrorBadValue &error) {
+    std::cerr << error.GetMessage() << std::endl;
+    return 1;
+  }
+  if (functions.empty()) {
+    std::cerr << "No clip functions given" << std::endl;
+    return 1;
+  }
+  bool intersect = options.count("intersect") > 0;
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
+  // Add CellIds as cell centerd field.
+  addCellIds(input);
+  std::string cellIdsVar("cellIds");
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> stageTimer;
+  EvaluateClipFunctions evaluate;
+  evaluate.Input = input;
+  evaluate.Functions = functions;
+  vtkm::cont::TryExecute(evaluate);
+  std::cout << "Time taken to evaluate " << functions.size() << " functions : "
+            << stageTimer.GetElapsedTime() << std::endl;
+
+  // The distances travel with the dataset as point fields.
+  vtkm::cont::DataSet withDistances = input;
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  std::vector<std::string> distanceVars;
+  for (size_t f = 0; f < functions.size(); f++) {
+    distanceVars.push_back("clipDistance" + std::to_string(f));
+    datasetFieldAdder.AddPointField(withDistances, distanceVars[f],
+                                    evaluate.Distances[f]);
+  }
+
+  ImplicitFieldPolicy policy;
+  std::vector<vtkm::cont::DataSet> outputs;
+  vtkm::cont::DataSet current = withDistances;
+  for (size_t f = 0; f < functions.size(); f++) {
+    stageTimer.Reset();
+    vtkm::cont::DataSet source = intersect ? current : withDistances;
+    vtkm::filter::ClipWithField clip;
+    clip.SetClipValue(0);
+    vtkm::filter::Result result = clip.Execute(source, distanceVars[f], policy);
+    clip.MapFieldOntoOutput(result, source.GetPointField(variable), policy);
+    clip.MapFieldOntoOutput(result, source.GetCellField(cellIdsVar), policy);
+    // The remaining functions of the intersection clip this output again.
+    if (intersect)
+      for (size_t g = f + 1; g < functions.size(); g++)
+        clip.MapFieldOntoOutput(result, source.GetPointField(distanceVars[g]),
+                                policy);
+    std::cout << "Function " << f << " : "
+              << source.GetCellSet(0).GetNumberOfCells() << " -> "
+              << result.GetDataSet().GetCellSet(0).GetNumberOfCells()
+              << " cells in " << stageTimer.GetElapsedTime() << std::endl;
+    if (intersect)
+      current = result.GetDataSet();
+    else
+      outputs.push_back(result.GetDataSet());
+  }
+  if (intersect)
+    outputs.push_back(current);
+  std::cout << "Time taken : " << timer.GetElapsedTime() << std::endl;
+
+  for (size_t i = 0; i < outputs.size(); i++) {
+    std::cout << "Filtered number of Cells"
+              << (intersect ? std::string() : " (" + std::to_string(i) + ")")
+              << " : " << outputs[i].GetCellSet(0).GetNumberOfCells()
+              << std::endl;
+    if (options.count("output"))
+      writeDataSet(outputs[i],
+                   intersect ? options["output"]
+                             : outputName(options, "." + std::to_string(i)),
+                   options.count("ascii") == 0);
+  }
+  ArrayPool::Global().PrintStatistics(std::cout);
+  return 0;
+}
+
+// Names of --fields=<a,b,...>, the variable and cellIds by default like the
+// eager clips.
+std::vector<std::string> requestedFields(char *variable,
+                                         std::map<std::string, std::string> &options) {
+  std::vector<std::string> names;
+  std::istringstream list(options.count("fields") ? options["fields"]
+                                                  : std::string(variable) + ",cellIds");
+  std::string name;
+  while (std::getline(list, name, ','))
+    if (!name.empty())
+      names.push_back(name);
+  return names;
+}
+
+// The plane clip (1) or the isovolume (2) with --lazy: the clip maps no field,
+// and the renderer and the writer have the ones they use mapped just before,
+// the variable for rendering and --fields for --output and --shm. Inputs with
+// many fields thus only pay for those that are written or drawn.
+int clipLazily(vtkm::cont::DataSet &input, char *variable,
+               std::vector<float> &params,
+               std::map<std::string, std::string> &options) {
+  int option = (int)params[0];
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
+  ImplicitFieldPolicy policy;
+  std::shared_ptr<LazyClipResult> lazy;
+  if (option == 1 && params.size() > 6) {
+    auto clip = std::make_shared<vtkm::filter::ClipWithImplicitFunction>();
+    clip->SetImplicitFunction(vtkm::cont::make_ImplicitFunctionHandle(
+        vtkm::Plane(vtkm::make_Vec(params[1], params[2], params[3]),
+                    vtkm::make_Vec(params[4], params[5], params[6]))));
+    lazy = std::make_shared<LazyClipResult>(clip, clip->Execute(input, policy),
+                                            input);
+  } else if (option == 2) {
+    auto clip = std::make_shared<vtkm::filter::ClipWithField>();
+    clip->SetClipValue((params.size() > 1) ? params[1] : 3.0f);
+    lazy = std::make_shared<LazyClipResult>(
+        clip, clip->Execute(input, std::string(variable), policy), input);
+  } else {
+    std::cout << "Suitable option/params not provided" << std::endl;
+    return 1;
+  }
+  std::cout << "Time taken for clip : " << timer.GetElapsedTime() << std::endl;
+  std::cout << "Filtered number of Cells : "
+            << lazy->GetDataSet().GetCellSet(0).GetNumberOfCells() << std::endl;
+  // The cellIds are only generated when they are written.
+  lazy->DeferField("cellIds", addCellIds);
+
+  if (options.count("render")) {
+    lazy->MapField(variable);
+    if (options["render"] == "serial")
+      renderAndWriteDataSet(lazy->GetDataSet(), variable);
+    else
+      renderViewsBatch(lazy->GetDataSet(), variable, 16, numberOfWorkers(options));
+  }
+  if (options.count("output") || options.count("shm")) {
+    std::vector<std::string> fields = requestedFields(variable, options);
+    size_t mapped = lazy->MapFields(fields);
+    if (mapped < fields.size())
+      std::cerr << "Mapped " << mapped << " of " << fields.size()
+                << " requested fields" << std::endl;
+    if (options.count("output"))
+      writeDataSet(lazy->GetDataSet(), options["output"],
+                   options.count("ascii") == 0);
+    if (options.count("shm"))
+      WriteSharedDataSet(options["shm"], lazy->GetDataSet());
+  }
+  std::cout << "Time taken for field mapping (" << lazy->GetNumberOfMappedFields()
+            << " of " << input.GetNumberOfFields() << " fields) : "
+            << lazy->GetMappingTime() << std::endl;
+  std::cout << "Time taken : " << timer.GetElapsedTime() << std::endl;
+
+  ArrayPool::Global().PrintStatistics(std::cout);
+  return 0;
+}
+
+struct TimeStep {
+  size_t Index;
+  std::vector<vtkm::cont::DataSet> Blocks;
+  std::vector<vtkm::cont::DataSet> Outputs;
+  vtkm::Id InputCells;
+  // Seconds since the start of the sweep.
+  vtkm::Float64 ReadStart, ReadEnd, ClipEnd, WriteEnd;
+};
+
+// Sweeps the timesteps through a three stage pipeline: a reader thread
+// parses step N+1 (and up to --prefetch steps ahead) while step N is clipped,
+// and a writer thread writes the outputs of earlier steps. The bounded queues
+// between the stages keep at most a few steps in memory.
+int clipTimeSeries(std::vector<std::vector<std::string>> &steps,
+                   char *variable, std::vector<float> &params,
+                   std::map<std::string, std::string> &options) {
+  BlockOperation operation = makeBlockOperation(variable, params);
+  if (!operation) {
+    std::cout << "Time series support the plane clip (1) and the "
+              << "isovolume (2)" << std::endl;
+    return 1;
+  }
+  size_t prefetch = options.count("prefetch")
+                        ? static_cast<size_t>(atoi(options["prefetch"].c_str()))
+                        : 2;
+  int workers = numberOfWorkers(options);
+  bool binary = options.count("ascii") == 0;
+
+  auto start = std::chrono::steady_clock::now();
+  auto now = [start]() {
+    return std::chrono::duration<vtkm::Float64>(
+               std::chrono::steady_clock::now() - start).count();
+  };
+
+  BoundedQueue<std::shared_ptr<TimeStep>> parsed(prefetch);
+  BoundedQueue<std::shared_ptr<TimeStep>> clipped(prefetch);
+  std::vector<std::shared_ptr<TimeStep>> done;
+
+  // A failed read ends the series after the steps already read. A failed
+  // clip or write stops every stage: the queues are cancelled, which
+  // releases a stage blocked on them. The first error of each stage is
+  // rethrown once the stages are joined.
+  std::exception_ptr readError, clipError, writeError;
+  std::thread reader([&]() {
+    try {
+      for (size_t i = 0; i < steps.size(); i++) {
+        auto step = std::make_shared<TimeStep>();
+        step->Index = i;
+        step->ReadStart = now();
+        for (const std::string &file : steps[i])
+          step->Blocks.push_back(LoadDataSet(file, variable));
+        step->ReadEnd = now();
+        if (!parsed.Push(step))
+          break;
+      }
+    } catch (...) {
+      readError = std::current_exception();
+    }
+    parsed.Close();
+  });
+
+  std::thread writer([&]() {
+    std::shared_ptr<TimeStep> step;
+    while (clipped.Pop(step)) {
+      if (options.count("output")) {
+        for (size_t b = 0; b < step->Outputs.size(); b++) {
+          std::string suffix = "." + std::to_string(step->Index);
+          if (step->Outputs.size() > 1)
+            suffix += "." + std::to_string(b);
+          std::string name = outputName(options, suffix);
+          if (writeDataSet(step->Outputs[b], name, binary) != 0) {
+            writeError = std::make_exception_ptr(
+                vtkm::io::ErrorIO("Cannot write step " +
+                                  std::to_string(step->Index) + " to " + name));
+            clipped.Cancel();
+            parsed.Cancel();
+            return;
+          }
+        }
+      }
+      step->Outputs.clear();
+      step->WriteEnd = now();
+      done.push_back(step);
+    }
+  });
+
+  try {
+    std::shared_ptr<TimeStep> step;
+    while (parsed.Pop(step)) {
+      step->InputCells = 0;
+      for (auto &block : step->Blocks)
+        step->InputCells += block.GetCellSet(0).GetNumberOfCells();
+      if (step->Blocks.size() > 1) {
+        vtkm::Id largeBlockCells = step->InputCells / workers + 1;
+        performMultiBlock(step->Blocks, operation, workers, largeBlockCells,
+                          step->Outputs);
+      } else if (!step->Blocks.empty()) {
+        vtkm::filter::Result result;
+        operation(step->Blocks[0], result);
+        step->Outputs.push_back(result.GetDataSet());
+      }
+      // The inputs are not needed any more, let the reader use the memory.
+      step->Blocks.clear();
+      step->ClipEnd = now();
+      if (!clipped.Push(step))
+        break;
+    }
+  } catch (...) {
+    clipError = std::current_exception();
+    parsed.Cancel();
+  }
+  clipped.Close();
+  reader.join();
+  writer.join();
+  for (std::exception_ptr error : {readError, clipError, writeError})
+    if (error)
+      std::rethrow_exception(error);
+  if (done.empty()) {
+    std::cerr << "No timestep was clipped" << std::endl;
+    return 1;
+  }
+
+  vtkm::Id totalCells = 0;
+  for (auto &finished : done) {
+    totalCells += finished->InputCells;
+    std::cout << "Step " << finished->Index << " : read "
+              << finished->ReadEnd - finished->ReadStart << ", clip done at "
+              << finished->ClipEnd << ", written at " << finished->WriteEnd
+              << ", latency " << finished->WriteEnd - finished->ReadStart
+              << std::endl;
+  }
+  vtkm::Float64 total = done.back()->WriteEnd;
+  std::cout << "Time taken for " << done.size() << " steps : " << total
+            << std::endl;
+  // Steady state rate, leaving out the pipeline filling up for the first step.
+  if (done.size() > 1) {
+    vtkm::Float64 steady = done.back()->WriteEnd - done.front()->WriteEnd;
+    std::cout << "Steady state throughput : " << (done.size() - 1) / steady
+              << " steps/s, "
+              << (totalCells - done.front()->InputCells) / steady
+              << " cells/s" << std::endl;
+  }
+  ArrayPool::Global().PrintStatistics(std::cout);
+  return 0;
+}
+
+// A dataset the service keeps in memory, with its cellIds already added and
+// its arrays already on the device, so that requests only read it.
+struct WarmDataSet {
+  vtkm::cont::DataSet Data;
+  vtkm::Float64 LoadTime;
+};
+
+// Brings a cell set to Device in both directions, so that the point to cell
+// connectivity of explicit cell sets is built as well.
+template <typename Device> struct PrepareCellSetForInput {
+  template <typename CellSetType>
+  void operator()(const CellSetType &cellSet) const {
+    cellSet.PrepareForInput(Device(), vtkm::TopologyElementTagPoint(),
+                            vtkm::TopologyElementTagCell());
+    cellSet.PrepareForInput(Device(), vtkm::TopologyElementTagCell(),
+                            vtkm::TopologyElementTagPoint());
+  }
+};
+
+// Moves the cells, coordinates and scalar fields of a warm dataset to the
+// device. In this VTK-m version the first PrepareForInput of an array handle
+// sets up its execution array without locking, so requests that share the
+// dataset must only find arrays that are already there. Fields of other
+// types are left on the host; the filters cannot read them anyway.
+struct PrepareWarmDataSet {
+  vtkm::cont::DataSet Data;
+
+  template <typename Device> bool operator()(Device) {
+    this->Data.GetCellSet(0).CastAndCall(PrepareCellSetForInput<Device>());
+    this->Data.GetCoordinateSystem().GetData().CastAndCall(
+        PrepareArrayForInput<Device>());
+    for (vtkm::Id i = 0; i < this->Data.GetNumberOfFields(); i++) {
+      try {
+        this->Data.GetField(i).GetData().ResetTypeAndStorageLists(
+            ScalarFieldTypeList(), ImplicitFieldStorageList())
+            .CastAndCall(PrepareArrayForInput<Device>());
+      } catch (vtkm::cont::ErrorBadValue &) {
+      }
+    }
+    return true;
+  }
+};
+
+// The datasets of the service, keyed by file and variable. The first request
+// for a key loads it; concurrent requests for the same key wait for that load
+// instead of reading the file again. A load that fails is forgotten so that
+// a later request can retry it.
+class WarmDataSets {
+public:
+  std::shared_ptr<WarmDataSet> Get(const std::string &filename,
+                                   const std::string &variable) {
+    std::string key = filename + "\n" + variable;
+    std::shared_future<std::shared_ptr<WarmDataSet>> entry;
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      auto found = this->Entries.find(key);
+      if (found == this->Entries.end()) {
+        auto load = [filename, variable]() {
+          if (IsFileList(filename))
+            throw vtkm::cont::ErrorBadValue("multi-block lists are not served");
+          vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> loadTimer;
+          auto warm = std::make_shared<WarmDataSet>();
+          warm->Data = LoadDataSet(filename, variable);
+          addCellIds(warm->Data);
+          PrepareWarmDataSet prepare{warm->Data};
+          vtkm::cont::TryExecute(prepare);
+          warm->LoadTime = loadTimer.GetElapsedTime();
+          return warm;
+        };
+        found = this->Entries.insert(std::make_pair(
+            key, std::async(std::launch::deferred, load).share())).first;
+      }
+      entry = found->second;
+    }
+    try {
+      return entry.get();
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Entries.erase(key);
+      throw;
+    }
+  }
+
+  size_t Size() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    return this->Entries.size();
+  }
+
+private:
+  std::map<std::string, std::shared_future<std::shared_ptr<WarmDataSet>>> Entries;
+  std::mutex Mutex;
+};
+
+// Operations of a service request by name, the numbers are the options of
+// the command line.
+int serviceOption(const std::string &operation) {
+  if (operation == "plane")
+    return 1;
+  if (operation == "clip")
+    return 2;
+  if (operation == "isovolume")
+    return 3;
+  if (operation == "contour")
+    return 4;
+  if (operation == "isoplane")
+    return 6;
+  return atoi(operation.c_str());
+}
+
+// Answers one request line:
+//
+//   <file> <variable> <operation> <params...> [--output=<file>] [--shm=<name>]
+//   load <file> <variable>
+//   stats
+//
+// where operation is plane, clip, isovolume, contour, isoplane or the option
+// number, followed by the parameters of the command line. The reply is a
+// single line, "ok key=value ..." or "error <message>".
+std::string handleRequest(const std::string &line, WarmDataSets &datasets,
+                          std::atomic<vtkm::Id> &served) {
+  std::istringstream tokens(line);
+  std::vector<std::string> positional;
+  std::map<std::string, std::string> options;
+  std::string token;
+  while (tokens >> token) {
+    if (token.compare(0, 2, "--") == 0) {
+      size_t split = token.find('=');
+      options[token.substr(2, split - 2)] =
+          (split == std::string::npos) ? "" : token.substr(split + 1);
+    } else {
+      positional.push_back(token);
+    }
+  }
+
+  std::ostringstream reply;
+  try {
+    if (positional.size() == 1 && positional[0] == "stats") {
+      reply << "ok datasets=" << datasets.Size() << " requests=" << served;
+      return reply.str();
+    }
+    bool load = positional.size() == 3 && positional[0] == "load";
+    if (positional.size() < (load ? 3u : 4u))
+      return "error expected <file> <variable> <operation> <params...>";
+    const std::string &filename = positional[load ? 1 : 0];
+    std::string variable = positional[load ? 2 : 1];
+
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> requestTimer;
+    std::shared_ptr<WarmDataSet> warm = datasets.Get(filename, variable);
+    vtkm::Float64 waited = requestTimer.GetElapsedTime();
+    if (load) {
+      reply << "ok cells=" << warm->Data.GetCellSet(0).GetNumberOfCells()
+            << " load=" << warm->LoadTime;
+      return reply.str();
+    }
+
+    std::vector<float> params(1, static_cast<float>(serviceOption(positional[2])));
+    for (size_t i = 3; i < positional.size(); i++)
+      params.push_back(static_cast<float>(atof(positional[i].c_str())));
+
+    // The filters take the dataset by reference; the copy shares its arrays.
+    vtkm::cont::DataSet input = warm->Data;
+    vtkm::filter::Result result;
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> operationTimer;
+    if (performOption(input, &variable[0], params, options, result) != 0)
+      return "error unknown operation or missing parameters: " + positional[2];
+    vtkm::cont::DataSet clipped = result.GetDataSet();
+    vtkm::Float64 elapsed = operationTimer.GetElapsedTime();
+
+    reply << "ok cells=" << clipped.GetCellSet(0).GetNumberOfCells()
+          << " time=" << elapsed << " wait=" << waited;
+    if (options.count("output")) {
+      if (writeDataSet(clipped, options["output"], options.count("ascii") == 0))
+        return "error cannot write " + options["output"];
+      reply << " output=" << options["output"];
+    }
+    if (options.count("shm")) {
+      WriteSharedDataSet(options["shm"], clipped);
+      reply << " shm=" << options["shm"];
+    }
+    served++;
+    return reply.str();
+  } catch (vtkm::cont::Error &error) {
+    return "error " + error.GetMessage();
+  } catch (std::exception &error) {
+    return std::string("error ") + error.what();
+  }
+}
+
+// --serve=<socket> keeps the process alive as a local clip service: datasets
+// are read once and stay loaded, and every connection on the Unix socket
+// may send any number of request lines (see
+// handleRequest). Connections are served on their own threads, while at most
+// --workers requests run at once, one at a time on CUDA where they would
+// share the device anyway. "shutdown" stops the service.
+int serveRequests(const std::string &socketPath, char *filename,
+                  char *variable, std::map<std::string, std::string> &options,
+                  const std::string &device) {
+  std::string error;
+  int listenFd = ListenLocalSocket(socketPath, error);
+  if (listenFd < 0) {
+    std::cerr << error << std::endl;
+    return 1;
+  }
+
+  WarmDataSets datasets;
+  std::atomic<vtkm::Id> served(0);
+  // The dataset of the command line is loaded before the first request.
+  std::cout << "Warming " << filename << " : "
+            << handleRequest(std::string("load ") + filename + " " + variable,
+                             datasets, served) << std::endl;
+
+  int workers = options.count("workers") || LowerCase(device) != "cuda"
+                    ? numberOfWorkers(options) : 1;
+  // Free execution slots; a request takes one and puts it back.
+  BoundedQueue<int> slots(static_cast<size_t>(workers));
+  for (int i = 0; i < workers; i++)
+    slots.Push(i);
+  std::cout << "Serving on " << socketPath << " with " << workers
+            << " workers" << std::endl;
+
+  // Open connections, their threads, and the threads that are done and wait
+  // to be joined at the next accept.
+  std::mutex connectionsMutex;
+  std::set<int> connections;
+  std::map<std::thread::id, std::thread> threads;
+  std::vector<std::thread::id> finished;
+  std::atomic<bool> stopping(false);
+  auto serveConnection = [&](int fd) {
+    LineReader reader(fd);
+    std::string line;
+    while (!stopping && reader.ReadLine(line)) {
+      if (line.empty())
+        continue;
+      if (line == "shutdown") {
+        stopping = true;
+        WriteLine(fd, "ok");
+        // Wakes up accept, and the other connections see end of input.
+        shutdown(listenFd, SHUT_RDWR);
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (int other : connections)
+          if (other != fd)
+            shutdown(other, SHUT_RD);
+        break;
+      }
+      int slot;
+      slots.Pop(slot);
+      std::string reply = handleRequest(line, datasets, served);
+      slots.Push(slot);
+      std::cout << "Request \"" << line << "\" : " << reply << std::endl;
+      if (!WriteLine(fd, reply))
+        break;
+    }
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.erase(fd);
+    close(fd);
+    finished.push_back(std::this_thread::get_id());
+  };
+
+  while (!stopping) {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    for (std::thread::id id : finished) {
+      threads[id].join();
+      threads.erase(id);
+    }
+    finished.clear();
+    if (stopping) {
+      close(fd);
+      break;
+    }
+    connections.insert(fd);
+    std::thread thread(serveConnection, fd);
+    threads[thread.get_id()] = std::move(thread);
+  }
+  for (auto &thread : threads)
+    thread.second.join();
+  close(listenFd);
+  unlink(socketPath.c_str());
+
+  std::cout << "Served " << served << " requests on " << datasets.Size()
+            << " datasets" << std::endl;
+  ArrayPool::Global().PrintStatistics(std::cout);
+  return 0;
+}
+
+// Numeric parameters are positional; anything of the form --key[=value] is
+// collected into options.
 int parseParameters(int argc, char **argv,
                     char **filename, char **variable,
-                    std::vector<float>& params)
+                    std::vector<float>& params,
+                    std::map<std::string, std::string>& options)
 {
   if (argc < 3)
     std::cerr << "Invalid number of arguments" << std::endl;
   *filename = argv[1];
   *variable = argv[2];
-  int numParams = argc - 3;
-  for(int i = 0; i < numParams; i++)
+  for(int i = 3; i < argc; i++)
   {
-    params.push_back(atof(argv[i+3]));
+    std::string arg(argv[i]);
+    if (arg.compare(0, 2, "--") == 0)
+    {
+      size_t split = arg.find('=');
+      options[arg.substr(2, split - 2)] =
+          (split == std::string::npos) ? "" : arg.substr(split + 1);
+      continue;
+    }
+    params.push_back(atof(argv[i]));
   }
+  return 0;
 }
 
 int main(int argc, char **argv) {
@@ -328,70 +1458,101 @@ int main(int argc, char **argv) {
   }
   char *filename, *variable;
   std::vector<float> params;
-  parseParameters(argc, argv, &filename, &variable, params);
-  // Read dataset
-  vtkm::io::reader::VTKDataSetReader reader(filename);
-  vtkm::cont::DataSet input = reader.ReadDataSet();
+  std::map<std::string, std::string> options;
+  parseParameters(argc, argv, &filename, &variable, params, options);
+
+  // --device=serial|tbb|cuda, TBB by default when available. --threads=N
+  // limits the TBB worker count.
+  std::string device = SelectDevice(options["device"]);
+  std::cout << "Running on device : " << device << std::endl;
+  // --pool recycles the host buffers the driver allocates itself.
+  ArrayPool::Global().SetEnabled(options.count("pool") > 0, device);
+#ifdef VTKM_ENABLE_TBB
+  int numThreads = options.count("threads") ? atoi(options["threads"].c_str())
+                                            : tbb::task_scheduler_init::automatic;
+  tbb::task_scheduler_init tbbInit(numThreads);
+  SetHostThreads(numThreads);
+  if (device == "TBB")
+    std::cout << "TBB threads : "
+              << (numThreads > 0 ? numThreads
+                                 : tbb::task_scheduler_init::default_num_threads())
+              << std::endl;
+#endif
+
+  if (options.count("serve"))
+    return serveRequests(options["serve"], filename, variable, options, device);
+
+  // Read dataset, the blocks of a .visit list, or build a
+  // synthetic:<field>:<dims> one in place.
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> readTimer;
+  std::vector<std::vector<std::string>> steps;
+  try {
+    steps = ListTimeSteps(filename);
+  } catch (vtkm::cont::Error &error) {
+    std::cerr << error.GetMessage() << std::endl;
+    return 1;
+  }
+  if (steps.empty())
+  {
+    std::cerr << "No input matches " << filename << std::endl;
+    exit(1);
+  }
+  if (steps.size() > 1)
+  {
+    std::cout << "Number of timesteps : " << steps.size() << std::endl;
+    try {
+      return clipTimeSeries(steps, variable, params, options);
+    } catch (vtkm::cont::Error &error) {
+      std::cerr << "Time series failed : " << error.GetMessage() << std::endl;
+      return 1;
+    }
+  }
+  std::vector<vtkm::cont::DataSet> blocks =
+      LoadBlocks(IsFileList(filename) ? filename : steps[0][0], variable);
+  std::cout << "Time taken to read : " << readTimer.GetElapsedTime() << std::endl;
+  if (blocks.empty())
+  {
+    std::cerr << "No blocks to clip in " << filename << std::endl;
+    return 1;
+  }
+  if (blocks.size() > 1)
+  {
+    std::cout << "Number of blocks : " << blocks.size() << std::endl;
+    return clipBlocks(blocks, variable, params, options);
+  }
+  vtkm::cont::DataSet input = blocks[0];
 
   // Query original dataset
   std::cout << "Original number of Cells : "
             << input.GetCellSet(0).GetNumberOfCells() << std::endl;
 
+  // Option 5 clips by several implicit functions at once.
+  if (params.size() > 0 && (int)params[0] == 5)
+    return clipFunctions(input, variable, options);
+  // --lazy leaves the field mapping of the plane clip and the isovolume to
+  // when a field is drawn or written.
+  if (options.count("lazy") && params.size() > 0 &&
+      ((int)params[0] == 1 || (int)params[0] == 2))
+    return clipLazily(input, variable, params, options);
+
   // Apply filter begins here.
   vtkm::filter::Result result;
   // Retrieve resultant dataset
   vtkm::cont::DataSet clipped;
 
 
-  int option = params.size() == 0 ? 0: (int)params[0];
-  float isoValMin = FLT_MIN, isoValMax = FLT_MAX;
-  std::vector<double> isoValues;
-  vtkm::Vec<vtkm::Float32, 3> origin;
-  vtkm::Vec<vtkm::Float32, 3> normal;
-
   //begin timing
   vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
 
-
-  switch (option) {
-  case 1 :
-    // Case of Implicit Function.
-    origin = vtkm::make_Vec(params[1], params[2], params[3]);
-    normal = vtkm::make_Vec(params[4], params[5], params[6]);
-    performTrivialClip(input, variable, result,origin, normal);
-    // Retrieve resultant dataset
-    clipped = result.GetDataSet();
-    break;
-  case 2 :
-    // Case for simple IsoVolume.
-    isoValMax = (params.size() > 1) ? params[1] : 3.0f;
-    std::cout << "Executing trivial IsoVolume." << std::endl;
-    performTrivialIsoVolume(input, variable, result, isoValMax);
-    // Retrieve resultant dataset
-    clipped = result.GetDataSet();
-    break;
-  case 3 :
-    // Case of Min-Max IsoVolume.
-    isoValMin = params[1];
-    isoValMax = params[2];
-    std::cout << "Executing Min-Max IsoVolume." << std::endl;
-    performMinMaxIsoVolume(input, variable, result, isoValMin, isoValMax);
-    // Retrieve resultant dataset
-    clipped = result.GetDataSet();
-    break;
-  case 4 :
-    // Case of Iso Surface.
-    for(int i = 1; i < params.size(); i++)
-      isoValues.push_back(params[i]);
-    std::cout << "Executing Iso-Surface." << std::endl;
-    performIsoSurface(input, variable, result, isoValues);
+  if (performOption(input, variable, params, options, result) == 0)
+  {
     // Retrieve resultant dataset
     clipped = result.GetDataSet();
-  break;
-  default:
+  }
+  else
+  {
     std::cout << "Suitable option/params not provided" << std::endl;
     clipped = input;
-    break;
   }
 
   // Query resultant dataset
@@ -406,5 +1567,34 @@ int main(int argc, char **argv) {
 
   std::cout << "Time taken : " << timer.GetElapsedTime() << std::endl;
 
+  // --render renders the 16 view gallery in batch, --render=serial uses the
+  // original one view at a time loop.
+  if (options.count("render"))
+  {
+    if (options["render"] == "serial")
+      renderAndWriteDataSet(clipped, variable);
+    else
+    {
+      int workers = options.count("workers") ? atoi(options["workers"].c_str())
+                                             : std::thread::hardware_concurrency();
+      renderViewsBatch(clipped, variable, 16, std::max(1, workers));
+    }
+  }
+
+  // --output=<file> writes the result, --ascii keeps the old writer.
+  if (options.count("output") &&
+      writeDataSet(clipped, options["output"], options.count("ascii") == 0))
+    return 1;
+  // --shm=<name> hands the result to local readers (splitcellproc shm:<name>,
+  // SplitCellReader/shmdataset.py) through shared memory instead.
+  if (options.count("shm"))
+  {
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> shmTimer;
+    WriteSharedDataSet(options["shm"], clipped);
+    std::cout << "Time taken to export to shared memory " << options["shm"]
+              << " : " << shmTimer.GetElapsedTime() << std::endl;
+  }
+
+  ArrayPool::Global().PrintStatistics(std::cout);
   return 0;
 }
@@ -0,0 +1,33 @@
+from __future__ import print_function
+import socket, sys, timeit
+
+# Client for clippingfilter --serve=<socket>. Every request argument is sent
+# as one line on a single connection and the reply is printed with the round
+# trip time, e.g.
+#
+#   python clipclient.py /tmp/clip.sock "data.vtk pressure clip 3.0" stats
+#
+# With no request arguments the lines are read from standard input.
+
+def request(connection, reader, line):
+  connection.sendall((line + "\n").encode())
+  return reader.readline().decode().rstrip("\n")
+
+if __name__ == "__main__":
+  if len(sys.argv) < 2:
+    print("Usage : clipclient.py <socket> [request ...]")
+    sys.exit(1)
+  connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+  connection.connect(sys.argv[1])
+  reader = connection.makefile("rb")
+  lines = sys.argv[2:] if len(sys.argv) > 2 else (l.strip() for l in sys.stdin)
+  failed = False
+  for line in lines:
+    if not line:
+      continue
+    start = timeit.default_timer()
+    reply = request(connection, reader, line)
+    print("%s -> %s (%f s)" % (line, reply, timeit.default_timer() - start))
+    failed = failed or not reply.startswith("ok")
+  connection.close()
+  sys.exit(1 if failed else 0)
@@ -0,0 +1,147 @@
+#ifndef ARRAY_POOL_H
+#define ARRAY_POOL_H
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/DynamicArrayHandle.h>
+#include <vtkm/cont/ErrorBadAllocation.h>
+
+#include "DeviceSelection.h"
+
+// Pool of host buffers for the transient arrays of the drivers. Acquire hands
+// out an ArrayHandle over a recycled buffer when one of a suitable size was
+// released before, so that loops over timesteps or blocks stop paying for
+// fresh allocations and their page faults. VTK-m does not let the storage of
+// arrays created inside its filters be replaced, so only the arrays the
+// drivers allocate themselves go through the pool.
+//
+// The pool is off unless a driver enables it, and Acquire/Release then fall
+// back to plain allocation and ReleaseResources. It stays off on a discrete
+// device, where the arrays live in device memory that VTK-m manages and a
+// host buffer would only add transfers.
+class ArrayPool {
+public:
+  static ArrayPool &Global() {
+    static ArrayPool pool;
+    return pool;
+  }
+
+  // device is the name returned by SelectDevice.
+  void SetEnabled(bool enabled, const std::string &device) {
+    std::string name = LowerCase(device);
+    this->Enabled = enabled && (name == "serial" || name == "tbb");
+    if (enabled && !this->Enabled)
+      std::cerr << "Array pool is not used on device " << device << std::endl;
+  }
+
+  template <typename T>
+  vtkm::cont::ArrayHandle<T> Acquire(vtkm::Id numValues) {
+    vtkm::cont::ArrayHandle<T> array;
+    if (!this->Enabled) {
+      array.Allocate(numValues);
+      return array;
+    }
+    size_t bytes = static_cast<size_t>(numValues) * sizeof(T);
+    void *buffer = nullptr;
+    size_t capacity = 0;
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Requests++;
+      // Smallest free buffer that fits, unless it would waste more than half.
+      auto candidate = this->Free.lower_bound(bytes);
+      if (candidate != this->Free.end() && candidate->first <= 2 * bytes + 4096) {
+        capacity = candidate->first;
+        buffer = candidate->second;
+        this->Free.erase(candidate);
+        this->Reuses++;
+      }
+    }
+    if (buffer == nullptr) {
+      capacity = bytes > 0 ? bytes : 1;
+      if (posix_memalign(&buffer, 64, capacity) != 0)
+        throw vtkm::cont::ErrorBadAllocation("Array pool is out of memory");
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      this->Capacity[buffer] = capacity;
+      this->PooledBytes += capacity;
+      if (this->PooledBytes > this->PeakBytes)
+        this->PeakBytes = this->PooledBytes;
+    }
+    // The handle sees the whole buffer, so that worklets writing numValues
+    // outputs never need to reallocate user memory.
+    array = vtkm::cont::make_ArrayHandle(static_cast<T *>(buffer),
+                                         static_cast<vtkm::Id>(capacity / sizeof(T)));
+    array.Shrink(numValues);
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Loans.push_back(Loan{vtkm::cont::DynamicArrayHandle(array), buffer});
+    return array;
+  }
+
+  // Returns the buffer of array to the pool. The buffer is the one recorded
+  // by Acquire, so no portal is requested and nothing is copied back from the
+  // device. Every other handle sharing it, such as a dataset field, must be
+  // gone or never read again: the next Acquire overwrites it.
+  template <typename T> void Release(vtkm::cont::ArrayHandle<T> &array) {
+    void *buffer = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(this->Mutex);
+      for (auto loan = this->Loans.begin(); loan != this->Loans.end(); ++loan)
+        if (loan->Array.IsSameType(array) &&
+            loan->Array.Cast<vtkm::cont::ArrayHandle<T>>() == array) {
+          buffer = loan->Buffer;
+          this->Loans.erase(loan);
+          break;
+        }
+    }
+    if (buffer == nullptr) {
+      array.ReleaseResources();
+      return;
+    }
+    array = vtkm::cont::ArrayHandle<T>();
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Free.insert(std::make_pair(this->Capacity[buffer], buffer));
+  }
+
+  void PrintStatistics(std::ostream &out) {
+    if (!this->Enabled)
+      return;
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    out << "Array pool requests : " << this->Requests << ", reused : "
+        << this->Reuses << " ("
+        << (this->Requests ? 100.0 * this->Reuses / this->Requests : 0.0)
+        << "%), peak pooled bytes : " << this->PeakBytes << std::endl;
+  }
+
+  ~ArrayPool() {
+    for (auto &buffer : this->Capacity)
+      free(buffer.first);
+  }
+
+private:
+  ArrayPool()
+      : Enabled(false), Requests(0), Reuses(0), PooledBytes(0), PeakBytes(0) {}
+
+  // A handle given out by Acquire and the pooled buffer behind it.
+  struct Loan {
+    vtkm::cont::DynamicArrayHandle Array;
+    void *Buffer;
+  };
+
+  bool Enabled;
+  std::mutex Mutex;
+  std::vector<Loan> Loans;
+  // Free buffers by capacity, and the capacity of every buffer ever handed out.
+  std::multimap<size_t, void *> Free;
+  std::map<void *, size_t> Capacity;
+  vtkm::Id Requests;
+  vtkm::Id Reuses;
+  size_t PooledBytes;
+  size_t PeakBytes;
+};
+
+#endif
@@ -0,0 +1,316 @@
+#ifndef BINARY_DATASET_WRITER_H
+#define BINARY_DATASET_WRITER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vtkm/VecTraits.h>
+#include <vtkm/cont/CellSetExplicit.h>
+#include <vtkm/cont/CellSetSingleType.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/ErrorBadValue.h>
+#include <vtkm/io/ErrorIO.h>
+#include <vtkm/io/writer/VTKDataSetWriter.h>
+
+// Writes a DataSet as a legacy VTK file in the BINARY flavour, which is what
+// VisIt's and VTK's legacy readers expect: big-endian values, one section per
+// array. Arrays are encoded in windows; each window is byte-swapped by several
+// threads and then handed to a single fwrite while the next window is being
+// encoded, so the disk only ever sees large sequential writes.
+//
+// Explicit and single type cell sets (every clip / contour output) are written
+// as UNSTRUCTURED_GRID. Anything else falls back to the ASCII writer in VTK-m.
+
+template <typename T> struct LegacyVTKType;
+template <> struct LegacyVTKType<vtkm::Float32> {
+  using Type = vtkm::Float32;
+  static const char *Name() { return "float"; }
+};
+template <> struct LegacyVTKType<vtkm::Float64> {
+  using Type = vtkm::Float64;
+  static const char *Name() { return "double"; }
+};
+template <> struct LegacyVTKType<vtkm::UInt8> {
+  using Type = vtkm::UInt8;
+  static const char *Name() { return "unsigned_char"; }
+};
+template <> struct LegacyVTKType<vtkm::Int32> {
+  using Type = vtkm::Int32;
+  static const char *Name() { return "int"; }
+};
+// VisIt reads avtOriginalCellNumbers and friends as 32 bit ints, and legacy
+// files store vtkIdType that way as well.
+template <> struct LegacyVTKType<vtkm::Int64> {
+  using Type = vtkm::Int32;
+  static const char *Name() { return "int"; }
+};
+
+// Converts a value to the type it is written as. 64 bit ids must fit the 32
+// bit ints of the file; one that does not would wrap silently, so it throws.
+template <typename OutType, typename InType>
+inline OutType ToLegacyValue(InType value) {
+  return static_cast<OutType>(value);
+}
+template <>
+inline vtkm::Int32 ToLegacyValue<vtkm::Int32, vtkm::Int64>(vtkm::Int64 value) {
+  if (value < std::numeric_limits<vtkm::Int32>::min() ||
+      value > std::numeric_limits<vtkm::Int32>::max())
+    throw vtkm::io::ErrorIO("Value " + std::to_string(value) +
+                            " does not fit the 32 bit ints of legacy VTK files");
+  return static_cast<vtkm::Int32>(value);
+}
+
+template <typename T> inline void SwapToBigEndian(T &value) {
+  char *bytes = reinterpret_cast<char *>(&value);
+  std::reverse(bytes, bytes + sizeof(T));
+}
+
+class BinaryDataSetWriter {
+public:
+  BinaryDataSetWriter(const std::string &filename)
+      : FileName(filename),
+        NumberOfThreads(std::max(1u, std::thread::hardware_concurrency())),
+        WindowSize(8 * 1024 * 1024) {}
+
+  void SetNumberOfThreads(int numThreads) {
+    this->NumberOfThreads = std::max(1, numThreads);
+  }
+
+  // Number of values encoded per write.
+  void SetWindowSize(vtkm::Id windowSize) {
+    this->WindowSize = std::max(vtkm::Id(1), windowSize);
+  }
+
+  void WriteDataSet(const vtkm::cont::DataSet &dataset,
+                    vtkm::Id cellSetIndex = 0) const {
+    const vtkm::cont::DynamicCellSet &cellSet =
+        dataset.GetCellSet(cellSetIndex);
+    if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>())) {
+      this->Write(dataset, cellSet.Cast<vtkm::cont::CellSetExplicit<>>());
+    } else if (cellSet.IsSameType(vtkm::cont::CellSetSingleType<>())) {
+      this->Write(dataset, cellSet.Cast<vtkm::cont::CellSetSingleType<>>());
+    } else {
+      std::cerr << "Binary writer only handles explicit cell sets, "
+                << "writing " << this->FileName << " as ASCII" << std::endl;
+      vtkm::io::writer::VTKDataSetWriter writer(this->FileName);
+      writer.WriteDataSet(dataset, cellSetIndex);
+    }
+  }
+
+private:
+  std::string FileName;
+  int NumberOfThreads;
+  vtkm::Id WindowSize;
+
+  // Fills [begin, end) of the output window with `encode(index)`, split
+  // across the writer threads.
+  template <typename OutType, typename EncodeFunctor>
+  void EncodeWindow(std::vector<OutType> &buffer, vtkm::Id begin, vtkm::Id end,
+                    const EncodeFunctor &encode) const {
+    buffer.resize(static_cast<size_t>(end - begin));
+    vtkm::Id chunk = (end - begin + this->NumberOfThreads - 1) /
+                     this->NumberOfThreads;
+    std::vector<std::future<void>> futures;
+    for (vtkm::Id start = begin; start < end; start += chunk) {
+      vtkm::Id stop = std::min(end, start + chunk);
+      futures.push_back(std::async(std::launch::async, [&, start, stop]() {
+        for (vtkm::Id i = start; i < stop; i++) {
+          OutType value = encode(i);
+          SwapToBigEndian(value);
+          buffer[static_cast<size_t>(i - begin)] = value;
+        }
+      }));
+    }
+    for (auto &future : futures)
+      future.get();
+  }
+
+  // Streams `numValues` encoded values to the file. While window k is being
+  // written, window k + 1 is encoded into the second buffer. Throws when a
+  // window is not written in full, e.g. on a full disk. errno is per thread,
+  // so the write returns its own, 0 on success.
+  template <typename OutType, typename EncodeFunctor>
+  void WriteEncoded(FILE *file, vtkm::Id numValues,
+                    const EncodeFunctor &encode) const {
+    std::vector<OutType> buffers[2];
+    std::future<int> pendingWrite;
+    int current = 0;
+    for (vtkm::Id begin = 0; begin < numValues; begin += this->WindowSize) {
+      vtkm::Id end = std::min(numValues, begin + this->WindowSize);
+      this->EncodeWindow(buffers[current], begin, end, encode);
+      if (pendingWrite.valid())
+        this->CheckWrite(pendingWrite.get());
+      std::vector<OutType> *toWrite = &buffers[current];
+      pendingWrite = std::async(std::launch::async, [file, toWrite]() {
+        errno = 0;
+        if (fwrite(toWrite->data(), sizeof(OutType), toWrite->size(), file) ==
+            toWrite->size())
+          return 0;
+        return errno != 0 ? errno : EIO;
+      });
+      current = 1 - current;
+    }
+    if (pendingWrite.valid())
+      this->CheckWrite(pendingWrite.get());
+    if (fputc('\n', file) == EOF)
+      this->WriteFailed(errno);
+  }
+
+  void CheckWrite(int error) const {
+    if (error != 0)
+      this->WriteFailed(error);
+  }
+
+  void WriteFailed(int error) const {
+    throw vtkm::io::ErrorIO("Error writing " + this->FileName + ": " +
+                            strerror(error));
+  }
+
+  struct WritePoints {
+    const BinaryDataSetWriter *Self;
+    FILE *File;
+
+    template <typename T, typename S>
+    void operator()(const vtkm::cont::ArrayHandle<T, S> &points) const {
+      using Traits = vtkm::VecTraits<T>;
+      auto portal = points.GetPortalConstControl();
+      vtkm::Id numPoints = points.GetNumberOfValues();
+      fprintf(this->File, "POINTS %lld float\n",
+              static_cast<long long>(numPoints));
+      this->Self->template WriteEncoded<vtkm::Float32>(
+          this->File, numPoints * 3, [&portal](vtkm::Id i) {
+            return static_cast<vtkm::Float32>(
+                Traits::GetComponent(portal.Get(i / 3), i % 3));
+          });
+    }
+  };
+
+  struct WriteField {
+    const BinaryDataSetWriter *Self;
+    FILE *File;
+    std::string Name;
+
+    template <typename T, typename S>
+    void operator()(const vtkm::cont::ArrayHandle<T, S> &values) const {
+      using Traits = vtkm::VecTraits<T>;
+      using ComponentType = typename Traits::ComponentType;
+      using OutType = typename LegacyVTKType<ComponentType>::Type;
+      const vtkm::IdComponent numComponents = Traits::NUM_COMPONENTS;
+      auto portal = values.GetPortalConstControl();
+      if (numComponents == 3)
+        fprintf(this->File, "VECTORS %s %s\n", this->Name.c_str(),
+                LegacyVTKType<ComponentType>::Name());
+      else
+        fprintf(this->File, "SCALARS %s %s %d\nLOOKUP_TABLE default\n",
+                this->Name.c_str(), LegacyVTKType<ComponentType>::Name(),
+                numComponents);
+      this->Self->template WriteEncoded<OutType>(
+          this->File, values.GetNumberOfValues() * numComponents,
+          [&portal, numComponents](vtkm::Id i) {
+            return ToLegacyValue<OutType>(Traits::GetComponent(
+                portal.Get(i / numComponents), i % numComponents));
+          });
+    }
+  };
+
+  void WriteFields(FILE *file, const vtkm::cont::DataSet &dataset,
+                   vtkm::cont::Field::AssociationEnum association,
+                   const char *section, vtkm::Id count) const {
+    bool headerWritten = false;
+    for (vtkm::Id i = 0; i < dataset.GetNumberOfFields(); i++) {
+      const vtkm::cont::Field &field = dataset.GetField(i);
+      if (field.GetAssociation() != association ||
+          field.GetData().GetNumberOfValues() != count)
+        continue;
+      if (!headerWritten) {
+        fprintf(file, "%s %lld\n", section, static_cast<long long>(count));
+        headerWritten = true;
+      }
+      try {
+        field.GetData().CastAndCall(WriteField{this, file, field.GetName()});
+      } catch (vtkm::cont::ErrorBadValue &) {
+        std::cerr << "Skipping field " << field.GetName()
+                  << " of unsupported type" << std::endl;
+      }
+    }
+  }
+
+  // Closes the file on every path; a failed write or close throws, so a
+  // truncated file is never reported as written.
+  template <typename CellSetType>
+  void Write(const vtkm::cont::DataSet &dataset,
+             const CellSetType &cellSet) const {
+    FILE *file = fopen(this->FileName.c_str(), "wb");
+    if (file == nullptr)
+      throw vtkm::cont::ErrorBadValue("Cannot open " + this->FileName);
+    try {
+      this->WriteSections(file, dataset, cellSet);
+    } catch (...) {
+      fclose(file);
+      throw;
+    }
+    bool failed = ferror(file) != 0;
+    if (fclose(file) != 0 || failed)
+      this->WriteFailed(errno != 0 ? errno : EIO);
+  }
+
+  template <typename CellSetType>
+  void WriteSections(FILE *file, const vtkm::cont::DataSet &dataset,
+                     const CellSetType &cellSet) const {
+
+    fprintf(file, "# vtk DataFile Version 3.0\nvtkm binary output\nBINARY\n"
+                  "DATASET UNSTRUCTURED_GRID\n");
+    dataset.GetCoordinateSystem().GetData().CastAndCall(
+        WritePoints{this, file});
+
+    vtkm::TopologyElementTagPoint point;
+    vtkm::TopologyElementTagCell cell;
+    auto shapes = cellSet.GetShapesArray(point, cell).GetPortalConstControl();
+    auto numIndices =
+        cellSet.GetNumIndicesArray(point, cell).GetPortalConstControl();
+    auto connectivity =
+        cellSet.GetConnectivityArray(point, cell).GetPortalConstControl();
+    vtkm::Id numCells = cellSet.GetNumberOfCells();
+
+    // Position of each cell in the CELLS section: its count followed by its
+    // point ids. The last entry is the size of the section.
+    std::vector<vtkm::Id> cellStart(static_cast<size_t>(numCells + 1), 0);
+    for (vtkm::Id i = 0; i < numCells; i++)
+      cellStart[i + 1] = cellStart[i] + numIndices.Get(i) + 1;
+    vtkm::Id cellsSize = cellStart[numCells];
+
+    fprintf(file, "CELLS %lld %lld\n", static_cast<long long>(numCells),
+            static_cast<long long>(cellsSize));
+    this->WriteEncoded<vtkm::Int32>(
+        file, cellsSize, [&](vtkm::Id i) {
+          vtkm::Id cellIndex =
+              std::upper_bound(cellStart.begin(), cellStart.end(), i) -
+              cellStart.begin() - 1;
+          vtkm::Id local = i - cellStart[cellIndex];
+          if (local == 0)
+            return static_cast<vtkm::Int32>(numIndices.Get(cellIndex));
+          return ToLegacyValue<vtkm::Int32>(
+              connectivity.Get(cellStart[cellIndex] - cellIndex + local - 1));
+        });
+
+    fprintf(file, "CELL_TYPES %lld\n", static_cast<long long>(numCells));
+    this->WriteEncoded<vtkm::Int32>(file, numCells, [&shapes](vtkm::Id i) {
+      return static_cast<vtkm::Int32>(shapes.Get(i));
+    });
+
+    this->WriteFields(file, dataset, vtkm::cont::Field::ASSOC_POINTS,
+                      "POINT_DATA", cellSet.GetNumberOfPoints());
+    this->WriteFields(file, dataset, vtkm::cont::Field::ASSOC_CELL_SET,
+                      "CELL_DATA", numCells);
+  }
+};
+
+#endif
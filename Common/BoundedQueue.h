@@ -0,0 +1,71 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+// Fixed capacity queue between pipeline stages. Push blocks while the queue
+// is full, so a fast producer cannot run more than Capacity items ahead, and
+// Pop blocks until an item arrives or the producer closes the queue. A
+// consumer that fails closes the queue too, which releases a producer
+// blocked in Push.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity)
+      : Capacity(capacity > 0 ? capacity : 1), Closed(false) {}
+
+  // Returns false, dropping item, when the queue is closed.
+  bool Push(T item) {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->NotFull.wait(lock, [this]() {
+      return this->Items.size() < this->Capacity || this->Closed;
+    });
+    if (this->Closed)
+      return false;
+    this->Items.push_back(std::move(item));
+    this->NotEmpty.notify_one();
+    return true;
+  }
+
+  // Returns false once the queue is closed and drained.
+  bool Pop(T &item) {
+    std::unique_lock<std::mutex> lock(this->Mutex);
+    this->NotEmpty.wait(lock, [this]() {
+      return !this->Items.empty() || this->Closed;
+    });
+    if (this->Items.empty())
+      return false;
+    item = std::move(this->Items.front());
+    this->Items.pop_front();
+    this->NotFull.notify_one();
+    return true;
+  }
+
+  void Close() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Closed = true;
+    this->NotEmpty.notify_all();
+    this->NotFull.notify_all();
+  }
+
+  // Closes the queue and drops the items still in it.
+  void Cancel() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Closed = true;
+    this->Items.clear();
+    this->NotEmpty.notify_all();
+    this->NotFull.notify_all();
+  }
+
+private:
+  size_t Capacity;
+  bool Closed;
+  std::deque<T> Items;
+  std::mutex Mutex;
+  std::condition_variable NotEmpty;
+  std::condition_variable NotFull;
+};
+
+#endif
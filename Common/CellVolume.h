@@ -0,0 +1,110 @@
+#ifndef CELL_VOLUME_H
+#define CELL_VOLUME_H
+
+#include <cmath>
+#include <vector>
+
+#include <vtkm/CellShape.h>
+#include <vtkm/VectorAnalysis.h>
+#include <vtkm/cont/CellSetExplicit.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/ErrorBadValue.h>
+
+// Host side volume of clip outputs, for checking that two clips of the same
+// dataset keep the same region.
+
+using HostPoint = vtkm::Vec<vtkm::Float64, 3>;
+
+// Copies an array of any storage to a host vector of T.
+template <typename T> struct CopyArrayToHost {
+  std::vector<T> &m_values;
+
+  CopyArrayToHost(std::vector<T> &values) : m_values(values) {}
+
+  template <typename U, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<U, Storage> &array) const {
+    auto portal = array.GetPortalConstControl();
+    m_values.resize(static_cast<size_t>(portal.GetNumberOfValues()));
+    for (vtkm::Id i = 0; i < portal.GetNumberOfValues(); i++)
+      m_values[static_cast<size_t>(i)] = static_cast<T>(portal.Get(i));
+  }
+};
+
+inline vtkm::Float64 TetVolume(const HostPoint &a, const HostPoint &b,
+                               const HostPoint &c, const HostPoint &d) {
+  return std::fabs(vtkm::dot(b - a, vtkm::Cross(c - a, d - a))) / 6.0;
+}
+
+// Volume of a 3D cell as the sum of its tetrahedra; 0 for other shapes.
+inline vtkm::Float64 CellVolume(vtkm::UInt8 shape,
+                                const std::vector<HostPoint> &p) {
+  // Six tetrahedra around the diagonal 0-6 of a hexahedron.
+  static const int hexTets[6][4] = {{0, 1, 2, 6}, {0, 2, 3, 6}, {0, 3, 7, 6},
+                                    {0, 7, 4, 6}, {0, 4, 5, 6}, {0, 5, 1, 6}};
+  static const int voxelToHex[8] = {0, 1, 3, 2, 4, 5, 7, 6};
+  static const int wedgeTets[3][4] = {{0, 1, 2, 5}, {0, 1, 5, 4}, {0, 4, 5, 3}};
+  static const int pyramidTets[2][4] = {{0, 1, 2, 4}, {0, 2, 3, 4}};
+  vtkm::Float64 volume = 0;
+  switch (shape) {
+  case vtkm::CELL_SHAPE_TETRA:
+    volume = TetVolume(p[0], p[1], p[2], p[3]);
+    break;
+  case vtkm::CELL_SHAPE_HEXAHEDRON:
+    for (auto &t : hexTets)
+      volume += TetVolume(p[t[0]], p[t[1]], p[t[2]], p[t[3]]);
+    break;
+  case vtkm::CELL_SHAPE_VOXEL:
+    for (auto &t : hexTets)
+      volume += TetVolume(p[voxelToHex[t[0]]], p[voxelToHex[t[1]]],
+                          p[voxelToHex[t[2]]], p[voxelToHex[t[3]]]);
+    break;
+  case vtkm::CELL_SHAPE_WEDGE:
+    for (auto &t : wedgeTets)
+      volume += TetVolume(p[t[0]], p[t[1]], p[t[2]], p[t[3]]);
+    break;
+  case vtkm::CELL_SHAPE_PYRAMID:
+    for (auto &t : pyramidTets)
+      volume += TetVolume(p[t[0]], p[t[1]], p[t[2]], p[t[3]]);
+    break;
+  default:
+    break;
+  }
+  return volume;
+}
+
+// Total volume of the cells of a clip output, which is an explicit cell set.
+inline vtkm::Float64 DataSetVolume(const vtkm::cont::DataSet &output) {
+  vtkm::cont::DynamicCellSet cellSet = output.GetCellSet(0);
+  if (cellSet.GetNumberOfCells() == 0)
+    return 0;
+  if (!cellSet.IsSameType(vtkm::cont::CellSetExplicit<>()))
+    throw vtkm::cont::ErrorBadValue("Clip output is not an explicit cell set");
+  auto explicitSet = cellSet.Cast<vtkm::cont::CellSetExplicit<>>();
+  vtkm::TopologyElementTagPoint point;
+  vtkm::TopologyElementTagCell cell;
+  auto shapes = explicitSet.GetShapesArray(point, cell).GetPortalConstControl();
+  auto numIndices =
+      explicitSet.GetNumIndicesArray(point, cell).GetPortalConstControl();
+  auto connectivity =
+      explicitSet.GetConnectivityArray(point, cell).GetPortalConstControl();
+
+  std::vector<HostPoint> coordinates;
+  output.GetCoordinateSystem().GetData().CastAndCall(
+      CopyArrayToHost<HostPoint>(coordinates));
+
+  vtkm::Float64 volume = 0;
+  std::vector<HostPoint> cellPoints;
+  vtkm::Id offset = 0;
+  for (vtkm::Id c = 0; c < cellSet.GetNumberOfCells(); c++) {
+    vtkm::IdComponent count = numIndices.Get(c);
+    cellPoints.resize(static_cast<size_t>(count));
+    for (vtkm::IdComponent i = 0; i < count; i++)
+      cellPoints[static_cast<size_t>(i)] =
+          coordinates[static_cast<size_t>(connectivity.Get(offset + i))];
+    offset += count;
+    volume += CellVolume(shapes.Get(c), cellPoints);
+  }
+  return volume;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef DEVICE_SELECTION_H
+#define DEVICE_SELECTION_H
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <vtkm/ListTag.h>
+#include <vtkm/cont/DeviceAdapter.h>
+#include <vtkm/cont/DeviceAdapterListTag.h>
+#include <vtkm/cont/RuntimeDeviceTracker.h>
+#include <vtkm/cont/serial/DeviceAdapterSerial.h>
+#ifdef VTKM_ENABLE_TBB
+#include <vtkm/cont/tbb/DeviceAdapterTBB.h>
+#include <tbb/task_scheduler_init.h>
+#endif
+#if defined(VTKM_ENABLE_CUDA) && defined(__CUDACC__)
+#include <vtkm/cont/cuda/DeviceAdapterCuda.h>
+#endif
+
+// Runtime device selection. Everything that goes through TryExecute, which
+// includes the filters and the ray tracer, consults the global runtime device
+// tracker, so forcing a device there moves the whole pipeline onto it.
+
+inline std::string LowerCase(std::string name) {
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  return name;
+}
+
+// TBB when VTK-m was built with it, so CPU-only nodes use all of their cores.
+inline std::string DefaultDeviceName() {
+#ifdef VTKM_ENABLE_TBB
+  return "tbb";
+#else
+  return "serial";
+#endif
+}
+
+template <typename Device> std::string DeviceName(Device) {
+  return vtkm::cont::DeviceAdapterTraits<Device>::GetName();
+}
+
+struct ForceDeviceByName {
+  std::string Requested;
+  std::string Selected;
+
+  template <typename Device> void operator()(Device device) {
+    vtkm::cont::RuntimeDeviceTracker tracker =
+        vtkm::cont::GetGlobalRuntimeDeviceTracker();
+    if (!this->Selected.empty() ||
+        !vtkm::cont::DeviceAdapterTraits<Device>::Valid ||
+        LowerCase(DeviceName(device)) != this->Requested ||
+        !tracker.CanRunOn(device))
+      return;
+    tracker.ForceDevice(device);
+    this->Selected = DeviceName(device);
+  }
+};
+
+// Forces the named device ("serial", "tbb" or "cuda", empty for the default)
+// and returns the name of the device actually in use. A device that was not
+// compiled in or cannot run here falls back to the default, then to serial.
+inline std::string SelectDevice(const std::string &requested) {
+  vtkm::cont::GetGlobalRuntimeDeviceTracker().Reset();
+  std::string candidates[] = {LowerCase(requested), DefaultDeviceName(),
+                              "serial"};
+  for (const std::string &candidate : candidates) {
+    if (candidate.empty())
+      continue;
+    ForceDeviceByName functor;
+    functor.Requested = candidate;
+    vtkm::ListForEach(functor, VTKM_DEFAULT_DEVICE_ADAPTER_LIST_TAG());
+    if (!functor.Selected.empty()) {
+      if (!requested.empty() && candidate != LowerCase(requested))
+        std::cerr << "Device " << requested << " is not available, using "
+                  << functor.Selected << std::endl;
+      return functor.Selected;
+    }
+  }
+  return "none";
+}
+
+// Brings an array to Device ahead of the stage that reads it there.
+template <typename Device> struct PrepareArrayForInput {
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &array) const {
+    array.PrepareForInput(Device());
+  }
+};
+
+// Thread count for the host code that runs outside TBB, such as the SIMD
+// classifier. Drivers that take --threads record it here along with the TBB
+// scheduler; zero or less means every core.
+inline int &HostThreadSetting() {
+  static int numThreads = 0;
+  return numThreads;
+}
+
+inline void SetHostThreads(int numThreads) { HostThreadSetting() = numThreads; }
+
+inline int HostThreads() {
+  int numThreads = HostThreadSetting();
+  return numThreads > 0
+             ? numThreads
+             : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <vtkm/cont/ErrorBadValue.h>
+#include <vtkm/io/ErrorIO.h>
+#include <vtkm/rendering/Canvas.h>
+
+#ifdef CLIP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// Converts the canvas color buffer (bottom row first, floats in [0, 1]) to
+// 8 bit RGB rows ordered top to bottom, the order image files expect.
+inline std::vector<unsigned char>
+CanvasToRGB(const vtkm::rendering::Canvas &canvas) {
+  const vtkm::Id width = canvas.GetWidth();
+  const vtkm::Id height = canvas.GetHeight();
+  std::vector<unsigned char> rgb(static_cast<size_t>(width * height * 3));
+  auto colors = canvas.GetColorBuffer().GetPortalConstControl();
+  for (vtkm::Id y = 0; y < height; y++) {
+    for (vtkm::Id x = 0; x < width; x++) {
+      vtkm::Vec<vtkm::Float32, 4> color = colors.Get(y * width + x);
+      size_t out = static_cast<size_t>(((height - 1 - y) * width + x) * 3);
+      for (int c = 0; c < 3; c++) {
+        vtkm::Float32 value = color[c] < 0.f ? 0.f : (color[c] > 1.f ? 1.f : color[c]);
+        rgb[out + c] = static_cast<unsigned char>(value * 255.f + 0.5f);
+      }
+    }
+  }
+  return rgb;
+}
+
+// Closes file, throwing if any write to it or the close itself failed, so a
+// truncated image is never reported as written.
+inline void CloseImageFile(FILE *file, const std::string &filename, bool written) {
+  written = written && ferror(file) == 0;
+  if (fclose(file) != 0 || !written)
+    throw vtkm::io::ErrorIO("Error writing " + filename + ": " + strerror(errno));
+}
+
+inline void WritePPM(const std::string &filename, vtkm::Id width,
+                     vtkm::Id height, const std::vector<unsigned char> &rgb) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == nullptr)
+    throw vtkm::cont::ErrorBadValue("Cannot open " + filename);
+  fprintf(file, "P6\n%lld %lld\n255\n", static_cast<long long>(width),
+          static_cast<long long>(height));
+  bool written = fwrite(rgb.data(), 1, rgb.size(), file) == rgb.size();
+  CloseImageFile(file, filename, written);
+}
+
+#ifdef CLIP_HAVE_ZLIB
+inline bool WritePNGChunk(FILE *file, const char *type,
+                          const std::vector<unsigned char> &data) {
+  unsigned char header[8];
+  unsigned long length = static_cast<unsigned long>(data.size());
+  for (int i = 0; i < 4; i++) {
+    header[i] = static_cast<unsigned char>(length >> (24 - 8 * i));
+    header[4 + i] = static_cast<unsigned char>(type[i]);
+  }
+  uLong crc = crc32(0L, header + 4, 4);
+  crc = crc32(crc, data.data(), static_cast<uInt>(data.size()));
+  unsigned char footer[4];
+  for (int i = 0; i < 4; i++)
+    footer[i] = static_cast<unsigned char>(crc >> (24 - 8 * i));
+  return fwrite(header, 1, 8, file) == 8 &&
+         fwrite(data.data(), 1, data.size(), file) == data.size() &&
+         fwrite(footer, 1, 4, file) == 4;
+}
+
+inline void WritePNG(const std::string &filename, vtkm::Id width,
+                     vtkm::Id height, const std::vector<unsigned char> &rgb) {
+  // Every scanline is prefixed with filter type 0 (none).
+  const size_t rowBytes = static_cast<size_t>(width * 3);
+  std::vector<unsigned char> raw;
+  raw.reserve(static_cast<size_t>(height) * (rowBytes + 1));
+  for (vtkm::Id y = 0; y < height; y++) {
+    raw.push_back(0);
+    raw.insert(raw.end(), rgb.begin() + y * rowBytes,
+               rgb.begin() + (y + 1) * rowBytes);
+  }
+  uLongf compressedSize = compressBound(static_cast<uLong>(raw.size()));
+  std::vector<unsigned char> compressed(compressedSize);
+  int status = compress2(compressed.data(), &compressedSize, raw.data(),
+                         static_cast<uLong>(raw.size()), Z_DEFAULT_COMPRESSION);
+  if (status != Z_OK)
+    throw vtkm::io::ErrorIO("Cannot compress " + filename + ": zlib error " +
+                            std::to_string(status));
+  compressed.resize(compressedSize);
+
+  std::vector<unsigned char> ihdr(13, 0);
+  for (int i = 0; i < 4; i++) {
+    ihdr[i] = static_cast<unsigned char>(width >> (24 - 8 * i));
+    ihdr[4 + i] = static_cast<unsigned char>(height >> (24 - 8 * i));
+  }
+  ihdr[8] = 8; // bit depth
+  ihdr[9] = 2; // truecolor
+
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == nullptr)
+    throw vtkm::cont::ErrorBadValue("Cannot open " + filename);
+  const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  bool written = fwrite(signature, 1, 8, file) == 8 &&
+                 WritePNGChunk(file, "IHDR", ihdr) &&
+                 WritePNGChunk(file, "IDAT", compressed) &&
+                 WritePNGChunk(file, "IEND", std::vector<unsigned char>());
+  CloseImageFile(file, filename, written);
+}
+#endif
+
+// Writes PNG when zlib is available, PPM otherwise. Returns the file name
+// actually written.
+inline std::string WriteImage(const std::string &basename, vtkm::Id width,
+                              vtkm::Id height,
+                              const std::vector<unsigned char> &rgb) {
+#ifdef CLIP_HAVE_ZLIB
+  std::string filename = basename + ".png";
+  WritePNG(filename, width, height, rgb);
+#else
+  std::string filename = basename + ".ppm";
+  WritePPM(filename, width, height, rgb);
+#endif
+  return filename;
+}
+
+#endif
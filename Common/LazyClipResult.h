@@ -0,0 +1,117 @@
+#ifndef LAZY_CLIP_RESULT_H
+#define LAZY_CLIP_RESULT_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/ErrorBadValue.h>
+#include <vtkm/cont/Field.h>
+#include <vtkm/cont/Timer.h>
+#include <vtkm/filter/PolicyDefault.h>
+#include <vtkm/filter/Result.h>
+
+#include "SyntheticDataSet.h"
+
+// The output of a clip whose fields are mapped when they are first used
+// rather than right after the clip. The clip filters keep what mapping needs
+// (the interpolation weights of the new points and the input cell of every
+// output cell) until they are destroyed, so the result holds on to its
+// filter and to the input, and a field that is never asked for costs nothing.
+class LazyClipResult {
+public:
+  template <typename FilterType>
+  LazyClipResult(std::shared_ptr<FilterType> filter,
+                 const vtkm::filter::Result &result,
+                 const vtkm::cont::DataSet &input)
+      : Input(input), Output(result), MappingTime(0) {
+    // ImplicitFieldPolicy covers the scalar fields in every storage the
+    // clips see; vector fields, which it cannot cast, go through the
+    // default policy.
+    this->Map = [filter](vtkm::filter::Result &output,
+                         const vtkm::cont::Field &field) {
+      try {
+        ImplicitFieldPolicy policy;
+        return filter->MapFieldOntoOutput(output, field, policy);
+      } catch (vtkm::cont::ErrorBadValue &) {
+      }
+      try {
+        return filter->MapFieldOntoOutput(output, field,
+                                          vtkm::filter::PolicyDefault());
+      } catch (vtkm::cont::ErrorBadValue &) {
+        return false;
+      }
+    };
+  }
+
+  // Has add put the field name on the input the first time it is mapped,
+  // for fields that only exist for the sake of the output, such as cell ids.
+  void DeferField(const std::string &name,
+                  std::function<void(vtkm::cont::DataSet &)> add) {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    this->Deferred[name] = add;
+  }
+
+  // The cells and coordinates of the clip, with the fields mapped so far.
+  vtkm::cont::DataSet &GetDataSet() { return this->Output.GetDataSet(); }
+
+  // Maps the point or cell field name of the input onto the output unless it
+  // already is. False when the input has no such field or it cannot be mapped.
+  bool MapField(const std::string &name) {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    if (this->Mapped.count(name))
+      return true;
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> mapTimer;
+    auto deferred = this->Deferred.find(name);
+    if (deferred != this->Deferred.end()) {
+      deferred->second(this->Input);
+      this->Deferred.erase(deferred);
+    }
+    for (vtkm::Id i = 0; i < this->Input.GetNumberOfFields(); i++) {
+      const vtkm::cont::Field &field = this->Input.GetField(i);
+      if (field.GetName() != name)
+        continue;
+      bool mapped = this->Map(this->Output, field);
+      this->MappingTime += mapTimer.GetElapsedTime();
+      if (mapped)
+        this->Mapped.insert(name);
+      return mapped;
+    }
+    return false;
+  }
+
+  // Maps every field of names, returning how many could be mapped.
+  size_t MapFields(const std::vector<std::string> &names) {
+    size_t count = 0;
+    for (const std::string &name : names)
+      count += this->MapField(name) ? 1 : 0;
+    return count;
+  }
+
+  size_t GetNumberOfMappedFields() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    return this->Mapped.size();
+  }
+
+  // Seconds spent mapping fields so far.
+  vtkm::Float64 GetMappingTime() {
+    std::lock_guard<std::mutex> lock(this->Mutex);
+    return this->MappingTime;
+  }
+
+private:
+  vtkm::cont::DataSet Input;
+  vtkm::filter::Result Output;
+  std::function<bool(vtkm::filter::Result &, const vtkm::cont::Field &)> Map;
+  std::set<std::string> Mapped;
+  std::map<std::string, std::function<void(vtkm::cont::DataSet &)>> Deferred;
+  vtkm::Float64 MappingTime;
+  std::mutex Mutex;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Line based request/response over a Unix domain stream socket, for the
+// drivers that run as a local service. Every request and every response is a
+// single line terminated by '\n'.
+
+// Binds and listens on path, replacing a stale socket file left by an earlier
+// run. Returns -1 and sets error on failure.
+inline int ListenLocalSocket(const std::string &path, std::string &error) {
+  sockaddr_un address;
+  if (path.size() >= sizeof(address.sun_path)) {
+    error = "socket path too long: " + path;
+    return -1;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    error = std::string("socket: ") + strerror(errno);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  unlink(path.c_str());
+  if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(fd, 64) != 0) {
+    error = path + ": " + strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Buffered reader of the lines a client sends on one connection.
+class LineReader {
+public:
+  explicit LineReader(int fd) : Fd(fd) {}
+
+  // False once the client closed the connection.
+  bool ReadLine(std::string &line) {
+    size_t end;
+    while ((end = this->Buffer.find('\n')) == std::string::npos) {
+      char chunk[4096];
+      ssize_t count = read(this->Fd, chunk, sizeof(chunk));
+      if (count < 0 && errno == EINTR)
+        continue;
+      if (count <= 0) {
+        // A last request without a newline still counts.
+        line.swap(this->Buffer);
+        this->Buffer.clear();
+        return !line.empty();
+      }
+      this->Buffer.append(chunk, static_cast<size_t>(count));
+    }
+    line = this->Buffer.substr(0, end);
+    this->Buffer.erase(0, end + 1);
+    if (!line.empty() && line[line.size() - 1] == '\r')
+      line.erase(line.size() - 1);
+    return true;
+  }
+
+private:
+  int Fd;
+  std::string Buffer;
+};
+
+inline bool WriteLine(int fd, const std::string &line) {
+  std::string data = line + "\n";
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t count = send(fd, data.data() + written, data.size() - written,
+                         MSG_NOSIGNAL);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return false;
+    written += static_cast<size_t>(count);
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef MIN_MAX_ISO_VOLUME_H
+#define MIN_MAX_ISO_VOLUME_H
+
+#include <string>
+
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/DynamicArrayHandle.h>
+#include <vtkm/cont/TryExecute.h>
+#include <vtkm/filter/ClipWithField.h>
+#include <vtkm/worklet/DispatcherMapField.h>
+#include <vtkm/worklet/WorkletMapField.h>
+
+#include "SyntheticDataSet.h"
+
+// The isovolume between two values with two clips. ClipWithField keeps the
+// values above its clip value, so the first clip keeps variable >= isoValMin,
+// the field of its output is negated in place, the second clip keeps
+// -variable >= -isoValMax, and negating again restores the field.
+
+class NegateFieldValues : public vtkm::worklet::WorkletMapField {
+public:
+  typedef void ControlSignature(FieldInOut<> val);
+  typedef void ExecutionSignature(_1);
+
+  template <typename T> VTKM_EXEC void operator()(T &val) const { val = -val; }
+};
+
+struct NegateField {
+  vtkm::cont::DynamicArrayHandle FieldData;
+
+  template <typename Device> bool operator()(Device) {
+    vtkm::worklet::DispatcherMapField<NegateFieldValues, Device>()
+        .Invoke(this->FieldData);
+    return true;
+  }
+};
+
+// Maps variable and, when given, the cell field cellField onto result.
+inline int MinMaxIsoVolume(vtkm::cont::DataSet &input,
+                           const std::string &variable,
+                           const std::string &cellField,
+                           vtkm::Float32 isoValMin, vtkm::Float32 isoValMax,
+                           vtkm::filter::Result &result) {
+  vtkm::filter::Result firstResult, secondResult;
+  vtkm::filter::ClipWithField firstClip, secondClip;
+  ImplicitFieldPolicy policy;
+
+  // Apply clip with Min.
+  firstClip.SetClipValue(isoValMin);
+  firstResult = firstClip.Execute(input, variable, policy);
+  firstClip.MapFieldOntoOutput(firstResult, input.GetPointField(variable), policy);
+  if (!cellField.empty())
+    firstClip.MapFieldOntoOutput(firstResult, input.GetCellField(cellField), policy);
+
+  // Output of first clip, its field negated to apply clip once again.
+  vtkm::cont::DataSet &firstClipped = firstResult.GetDataSet();
+  NegateField negateFirst{firstClipped.GetPointField(variable).GetData()};
+  vtkm::cont::TryExecute(negateFirst);
+
+  // Apply clip with Max.
+  secondClip.SetClipValue(-isoValMax);
+  secondResult = secondClip.Execute(firstClipped, variable, policy);
+  secondClip.MapFieldOntoOutput(secondResult,
+                                firstClipped.GetPointField(variable), policy);
+  if (!cellField.empty())
+    secondClip.MapFieldOntoOutput(secondResult,
+                                  firstClipped.GetCellField(cellField), policy);
+
+  // Negate the field back to its original values.
+  vtkm::cont::DataSet &secondClipped = secondResult.GetDataSet();
+  NegateField negateSecond{secondClipped.GetPointField(variable).GetData()};
+  vtkm::cont::TryExecute(negateSecond);
+
+  // Result of the Min-Max IsoVolume operation.
+  result = secondResult;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef MULTI_BLOCK_H
+#define MULTI_BLOCK_H
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <future>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glob.h>
+
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/ErrorBadValue.h>
+
+#include "SyntheticDataSet.h"
+
+// Multi-block inputs are given as a VisIt .visit file: an optional
+// "!NBLOCKS <n>" line followed by one file per block (and, for time series,
+// per timestep). Relative paths are taken from the directory of the list.
+
+inline bool IsFileList(const std::string &filename) {
+  return filename.size() > 6 &&
+         filename.compare(filename.size() - 6, 6, ".visit") == 0;
+}
+
+// Returns the files of the list in order, and the number of blocks per
+// timestep in numBlocks (1 when the list does not say).
+inline std::vector<std::string> ReadFileList(const std::string &listFile,
+                                             int &numBlocks) {
+  std::ifstream list(listFile.c_str());
+  if (!list)
+    throw vtkm::cont::ErrorBadValue("Cannot open " + listFile);
+  size_t slash = listFile.find_last_of('/');
+  std::string directory =
+      (slash == std::string::npos) ? "" : listFile.substr(0, slash + 1);
+
+  std::vector<std::string> files;
+  numBlocks = 1;
+  std::string line;
+  while (std::getline(list, line)) {
+    std::istringstream words(line);
+    std::string word;
+    if (!(words >> word) || word[0] == '#')
+      continue;
+    if (word == "!NBLOCKS") {
+      if (!(words >> numBlocks) || numBlocks < 1)
+        throw vtkm::cont::ErrorBadValue("Invalid !NBLOCKS count in " + listFile);
+      continue;
+    }
+    files.push_back((word[0] == '/' || IsSyntheticSpec(word)) ? word
+                                                              : directory + word);
+  }
+  return files;
+}
+
+// The timesteps of a series, each a list of block files: consecutive groups
+// of a .visit list, the sorted matches of a shell pattern such as
+// "run/step_*.vtk", or the single file or spec given.
+inline std::vector<std::vector<std::string>>
+ListTimeSteps(const std::string &filename) {
+  std::vector<std::vector<std::string>> steps;
+  if (IsFileList(filename)) {
+    int numBlocks;
+    std::vector<std::string> files = ReadFileList(filename, numBlocks);
+    for (size_t first = 0; first < files.size(); first += numBlocks)
+      steps.push_back(std::vector<std::string>(
+          files.begin() + first,
+          files.begin() + std::min(files.size(), first + numBlocks)));
+  } else if (!IsSyntheticSpec(filename) &&
+             filename.find_first_of("*?[") != std::string::npos) {
+    glob_t matches;
+    if (glob(filename.c_str(), 0, nullptr, &matches) == 0)
+      for (size_t i = 0; i < matches.gl_pathc; i++)
+        steps.push_back(std::vector<std::string>(1, matches.gl_pathv[i]));
+    globfree(&matches);
+  } else {
+    steps.push_back(std::vector<std::string>(1, filename));
+  }
+  return steps;
+}
+
+// Loads the blocks of the first timestep of a list on a few reader threads,
+// or the single file or synthetic spec otherwise.
+inline std::vector<vtkm::cont::DataSet> LoadBlocks(const std::string &filename,
+                                                   const std::string &variable) {
+  std::vector<vtkm::cont::DataSet> blocks;
+  if (!IsFileList(filename)) {
+    blocks.push_back(LoadDataSet(filename, variable));
+    return blocks;
+  }
+  int numBlocks;
+  std::vector<std::string> files = ReadFileList(filename, numBlocks);
+  if (files.size() > static_cast<size_t>(numBlocks))
+    files.resize(static_cast<size_t>(numBlocks));
+  blocks.resize(files.size());
+  std::atomic<size_t> nextBlock(0);
+  auto reader = [&]() {
+    for (size_t i = nextBlock++; i < files.size(); i = nextBlock++)
+      blocks[i] = LoadDataSet(files[i], variable);
+  };
+  std::vector<std::future<void>> readers;
+  size_t numReaders = std::min<size_t>(
+      files.size(), std::max(1u, std::thread::hardware_concurrency()));
+  for (size_t i = 0; i < numReaders; i++)
+    readers.push_back(std::async(std::launch::async, reader));
+  for (auto &read : readers)
+    read.get();
+  return blocks;
+}
+
+#endif
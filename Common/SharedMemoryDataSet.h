@@ -0,0 +1,425 @@
+#ifndef SHARED_MEMORY_DATASET_H
+#define SHARED_MEMORY_DATASET_H
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vtkm/VecTraits.h>
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/CellSetExplicit.h>
+#include <vtkm/cont/CellSetSingleType.h>
+#include <vtkm/cont/CoordinateSystem.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/DynamicArrayHandle.h>
+#include <vtkm/cont/ErrorBadValue.h>
+
+#include "SyntheticDataSet.h"
+
+// Exchange of clip outputs between local processes through a POSIX shared
+// memory segment (/dev/shm/<name>), instead of a VTK file that the other side
+// has to parse. The segment starts with a header and a table of arrays, each
+// giving its role, value type, component count, length and byte offset; the
+// values follow, 64 byte aligned, in the native byte order:
+//
+//   SharedHeader | SharedArrayEntry x NumArrays | values ...
+//
+// Roles are the point coordinates, the shapes, point counts, connectivity and
+// offsets of an explicit cell set, and point and cell fields by name. Readers
+// wrap the mapped values in ArrayHandles without copying them.
+// SplitCellReader/shmdataset.py reads the same layout from Python.
+
+enum SharedArrayRole : vtkm::UInt32 {
+  SHARED_COORDINATES = 0,
+  SHARED_SHAPES = 1,
+  SHARED_NUM_INDICES = 2,
+  SHARED_CONNECTIVITY = 3,
+  SHARED_OFFSETS = 4,
+  SHARED_POINT_FIELD = 5,
+  SHARED_CELL_FIELD = 6
+};
+
+enum SharedValueType : vtkm::UInt32 {
+  SHARED_FLOAT32 = 0,
+  SHARED_FLOAT64 = 1,
+  SHARED_INT32 = 2,
+  SHARED_INT64 = 3,
+  SHARED_UINT8 = 4
+};
+
+template <typename T> struct SharedTypeCode;
+template <> struct SharedTypeCode<vtkm::Float32> {
+  static const vtkm::UInt32 Value = SHARED_FLOAT32;
+};
+template <> struct SharedTypeCode<vtkm::Float64> {
+  static const vtkm::UInt32 Value = SHARED_FLOAT64;
+};
+template <> struct SharedTypeCode<vtkm::Int32> {
+  static const vtkm::UInt32 Value = SHARED_INT32;
+};
+template <> struct SharedTypeCode<vtkm::Int64> {
+  static const vtkm::UInt32 Value = SHARED_INT64;
+};
+template <> struct SharedTypeCode<vtkm::UInt8> {
+  static const vtkm::UInt32 Value = SHARED_UINT8;
+};
+
+struct SharedHeader {
+  char Magic[8]; // "VTKMSHM1"
+  vtkm::UInt32 Version;
+  vtkm::UInt32 NumArrays;
+  vtkm::UInt64 TotalBytes;
+};
+
+struct SharedArrayEntry {
+  char Name[64];
+  vtkm::UInt32 Role;
+  vtkm::UInt32 Type;
+  vtkm::UInt32 NumComponents;
+  vtkm::UInt32 Reserved;
+  vtkm::UInt64 NumValues;
+  vtkm::UInt64 Offset;
+};
+
+// Bytes per component of a SharedValueType.
+inline vtkm::UInt64 SharedValueSize(vtkm::UInt32 type) {
+  switch (type) {
+  case SHARED_FLOAT64:
+  case SHARED_INT64:
+    return 8;
+  case SHARED_UINT8:
+    return 1;
+  default:
+    return 4;
+  }
+}
+
+// Names are given without the leading slash shm_open wants.
+inline std::string SharedSegmentPath(const std::string &name) {
+  return (name.empty() || name[0] != '/') ? "/" + name : name;
+}
+
+inline void RemoveSharedDataSet(const std::string &name) {
+  shm_unlink(SharedSegmentPath(name).c_str());
+}
+
+// Collects the arrays of a dataset and copies them into a new segment.
+class SharedDataSetWriter {
+public:
+  // Writes dataset, which must have an explicit or single type cell set (as
+  // every clip output does), into the segment name, replacing any previous
+  // one. The segment stays until a reader or RemoveSharedDataSet unlinks it.
+  void Write(const std::string &name, const vtkm::cont::DataSet &dataset) {
+    this->Pending.clear();
+    dataset.GetCoordinateSystem().GetData().CastAndCall(
+        AddArray{this, SHARED_COORDINATES, "coordinates"});
+
+    const vtkm::cont::DynamicCellSet &cellSet = dataset.GetCellSet(0);
+    if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>()))
+      this->AddCellSet(cellSet.Cast<vtkm::cont::CellSetExplicit<>>());
+    else if (cellSet.IsSameType(vtkm::cont::CellSetSingleType<>()))
+      this->AddCellSet(cellSet.Cast<vtkm::cont::CellSetSingleType<>>());
+    else
+      throw vtkm::cont::ErrorBadValue(
+          "Shared memory export needs an explicit cell set");
+
+    for (vtkm::Id i = 0; i < dataset.GetNumberOfFields(); i++) {
+      const vtkm::cont::Field &field = dataset.GetField(i);
+      bool points = field.GetAssociation() == vtkm::cont::Field::ASSOC_POINTS;
+      if (!points && field.GetAssociation() != vtkm::cont::Field::ASSOC_CELL_SET)
+        continue;
+      try {
+        field.GetData().ResetStorageList(ImplicitFieldStorageList()).CastAndCall(
+            AddArray{this, points ? SHARED_POINT_FIELD : SHARED_CELL_FIELD,
+                     field.GetName()});
+      } catch (vtkm::cont::ErrorBadValue &) {
+        std::cerr << "Skipping field " << field.GetName()
+                  << " of unsupported type" << std::endl;
+      }
+    }
+    this->CopyToSegment(name);
+  }
+
+private:
+  struct PendingArray {
+    SharedArrayEntry Entry;
+    std::function<void(char *)> Copy;
+  };
+  std::vector<PendingArray> Pending;
+
+  template <typename T, typename Storage>
+  void Add(vtkm::UInt32 role, const std::string &name,
+           const vtkm::cont::ArrayHandle<T, Storage> &array) {
+    using Traits = vtkm::VecTraits<T>;
+    using ComponentType = typename Traits::ComponentType;
+    const vtkm::IdComponent numComponents = Traits::NUM_COMPONENTS;
+    PendingArray pending;
+    memset(&pending.Entry, 0, sizeof(SharedArrayEntry));
+    strncpy(pending.Entry.Name, name.c_str(), sizeof(pending.Entry.Name) - 1);
+    pending.Entry.Role = role;
+    pending.Entry.Type = SharedTypeCode<ComponentType>::Value;
+    pending.Entry.NumComponents = static_cast<vtkm::UInt32>(numComponents);
+    pending.Entry.NumValues = static_cast<vtkm::UInt64>(array.GetNumberOfValues());
+    pending.Copy = [array](char *destination) {
+      auto portal = array.GetPortalConstControl();
+      ComponentType *out = reinterpret_cast<ComponentType *>(destination);
+      for (vtkm::Id i = 0; i < portal.GetNumberOfValues(); i++) {
+        T value = portal.Get(i);
+        for (vtkm::IdComponent c = 0; c < numComponents; c++)
+          *out++ = Traits::GetComponent(value, c);
+      }
+    };
+    this->Pending.push_back(pending);
+  }
+
+  struct AddArray {
+    SharedDataSetWriter *Self;
+    vtkm::UInt32 Role;
+    std::string Name;
+
+    template <typename T, typename Storage>
+    void operator()(const vtkm::cont::ArrayHandle<T, Storage> &array) const {
+      this->Self->Add(this->Role, this->Name, array);
+    }
+  };
+
+  template <typename CellSetType> void AddCellSet(const CellSetType &cellSet) {
+    vtkm::TopologyElementTagPoint point;
+    vtkm::TopologyElementTagCell cell;
+    this->Add(SHARED_SHAPES, "shapes", cellSet.GetShapesArray(point, cell));
+    this->Add(SHARED_NUM_INDICES, "numindices",
+              cellSet.GetNumIndicesArray(point, cell));
+    this->Add(SHARED_CONNECTIVITY, "connectivity",
+              cellSet.GetConnectivityArray(point, cell));
+    this->Add(SHARED_OFFSETS, "offsets", cellSet.GetIndexOffsetArray(point, cell));
+  }
+
+  void CopyToSegment(const std::string &name) {
+    vtkm::UInt64 offset = sizeof(SharedHeader) +
+                          this->Pending.size() * sizeof(SharedArrayEntry);
+    for (PendingArray &pending : this->Pending) {
+      offset = (offset + 63) / 64 * 64;
+      pending.Entry.Offset = offset;
+      offset += pending.Entry.NumValues * pending.Entry.NumComponents *
+                SharedValueSize(pending.Entry.Type);
+    }
+
+    // A reader still attached to a previous segment of that name keeps its
+    // mapping; the new one is a different object.
+    std::string path = SharedSegmentPath(name);
+    shm_unlink(path.c_str());
+    int fd = shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0)
+      throw vtkm::cont::ErrorBadValue("Cannot create shared memory " + path);
+    if (ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+      close(fd);
+      throw vtkm::cont::ErrorBadValue("Cannot size shared memory " + path);
+    }
+    void *mapping =
+        mmap(nullptr, offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+      throw vtkm::cont::ErrorBadValue("Cannot map shared memory " + path);
+
+    char *base = static_cast<char *>(mapping);
+    SharedHeader header;
+    memcpy(header.Magic, "VTKMSHM1", 8);
+    header.Version = 1;
+    header.NumArrays = static_cast<vtkm::UInt32>(this->Pending.size());
+    header.TotalBytes = offset;
+    SharedArrayEntry *entries =
+        reinterpret_cast<SharedArrayEntry *>(base + sizeof(SharedHeader));
+    for (size_t i = 0; i < this->Pending.size(); i++) {
+      entries[i] = this->Pending[i].Entry;
+      this->Pending[i].Copy(base + this->Pending[i].Entry.Offset);
+    }
+    // The header goes last, so a reader never sees a complete magic over
+    // incomplete arrays.
+    memcpy(base, &header, sizeof(SharedHeader));
+    munmap(mapping, offset);
+    this->Pending.clear();
+  }
+
+};
+
+inline void WriteSharedDataSet(const std::string &name,
+                               const vtkm::cont::DataSet &dataset) {
+  SharedDataSetWriter writer;
+  writer.Write(name, dataset);
+}
+
+// Attaches to a segment written by SharedDataSetWriter. The arrays of the
+// returned datasets point into the mapping, which lives as long as this
+// object, so it must outlive them. The mapping is private: a filter writing
+// into an input array gets its own copy of the page.
+class SharedDataSet {
+public:
+  explicit SharedDataSet(const std::string &name)
+      : Mapping(nullptr), Size(0) {
+    std::string path = SharedSegmentPath(name);
+    int fd = shm_open(path.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+      throw vtkm::cont::ErrorBadValue("No shared memory segment " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        static_cast<size_t>(info.st_size) < sizeof(SharedHeader)) {
+      close(fd);
+      throw vtkm::cont::ErrorBadValue("Empty shared memory segment " + path);
+    }
+    this->Size = static_cast<size_t>(info.st_size);
+    this->Mapping = mmap(nullptr, this->Size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (this->Mapping == MAP_FAILED)
+      throw vtkm::cont::ErrorBadValue("Cannot map shared memory " + path);
+    if (!this->IsValid()) {
+      munmap(this->Mapping, this->Size);
+      throw vtkm::cont::ErrorBadValue("Not a VTK-m dataset segment " + path);
+    }
+  }
+
+  ~SharedDataSet() { munmap(this->Mapping, this->Size); }
+
+  SharedDataSet(const SharedDataSet &) = delete;
+  SharedDataSet &operator=(const SharedDataSet &) = delete;
+
+  // The entry of the array called name with the given role, or null.
+  const SharedArrayEntry *FindEntry(vtkm::UInt32 role,
+                                    const std::string &name = "") const {
+    const SharedHeader *header = static_cast<const SharedHeader *>(this->Mapping);
+    const SharedArrayEntry *entries = reinterpret_cast<const SharedArrayEntry *>(
+        static_cast<const char *>(this->Mapping) + sizeof(SharedHeader));
+    for (vtkm::UInt32 i = 0; i < header->NumArrays; i++)
+      if (entries[i].Role == role && (name.empty() || name == entries[i].Name))
+        return &entries[i];
+    return nullptr;
+  }
+
+  // The values of entry as an ArrayHandle of ValueType, which must match the
+  // stored type and component count.
+  template <typename ValueType>
+  vtkm::cont::ArrayHandle<ValueType> GetArray(const SharedArrayEntry &entry) const {
+    using ComponentType = typename vtkm::VecTraits<ValueType>::ComponentType;
+    if (entry.Type != SharedTypeCode<ComponentType>::Value ||
+        entry.NumComponents != vtkm::VecTraits<ValueType>::NUM_COMPONENTS)
+      throw vtkm::cont::ErrorBadValue(std::string("Unexpected type for ") +
+                                      entry.Name);
+    const ValueType *values = reinterpret_cast<const ValueType *>(
+        static_cast<const char *>(this->Mapping) + entry.Offset);
+    return vtkm::cont::make_ArrayHandle(values,
+                                        static_cast<vtkm::Id>(entry.NumValues));
+  }
+
+  vtkm::cont::DataSet GetDataSet() const {
+    vtkm::cont::DataSet dataset;
+    const SharedArrayEntry *coords = this->Require(SHARED_COORDINATES);
+    if (coords->Type == SHARED_FLOAT64)
+      dataset.AddCoordinateSystem(vtkm::cont::CoordinateSystem(
+          "coordinates", this->GetArray<vtkm::Vec<vtkm::Float64, 3>>(*coords)));
+    else
+      dataset.AddCoordinateSystem(vtkm::cont::CoordinateSystem(
+          "coordinates", this->GetArray<vtkm::Vec<vtkm::Float32, 3>>(*coords)));
+
+    vtkm::cont::CellSetExplicit<> cellSet("cells");
+    cellSet.Fill(static_cast<vtkm::Id>(coords->NumValues),
+                 this->GetArray<vtkm::UInt8>(*this->Require(SHARED_SHAPES)),
+                 this->GetArray<vtkm::IdComponent>(*this->Require(SHARED_NUM_INDICES)),
+                 this->GetArray<vtkm::Id>(*this->Require(SHARED_CONNECTIVITY)),
+                 this->GetArray<vtkm::Id>(*this->Require(SHARED_OFFSETS)));
+    dataset.AddCellSet(cellSet);
+
+    const SharedHeader *header = static_cast<const SharedHeader *>(this->Mapping);
+    const SharedArrayEntry *entries = reinterpret_cast<const SharedArrayEntry *>(
+        static_cast<const char *>(this->Mapping) + sizeof(SharedHeader));
+    for (vtkm::UInt32 i = 0; i < header->NumArrays; i++) {
+      const SharedArrayEntry &entry = entries[i];
+      if (entry.Role != SHARED_POINT_FIELD && entry.Role != SHARED_CELL_FIELD)
+        continue;
+      vtkm::cont::DynamicArrayHandle values = this->GetField(entry);
+      if (entry.Role == SHARED_POINT_FIELD)
+        dataset.AddField(vtkm::cont::Field(
+            entry.Name, vtkm::cont::Field::ASSOC_POINTS, values));
+      else
+        dataset.AddField(vtkm::cont::Field(entry.Name,
+                                           vtkm::cont::Field::ASSOC_CELL_SET,
+                                           cellSet.GetName(), values));
+    }
+    return dataset;
+  }
+
+private:
+  void *Mapping;
+  size_t Size;
+
+  // Checks the header and every entry against the size of the mapping, so
+  // that a truncated or foreign segment is rejected before any value is read.
+  bool IsValid() const {
+    const SharedHeader *header = static_cast<const SharedHeader *>(this->Mapping);
+    vtkm::UInt64 totalBytes = header->TotalBytes;
+    if (memcmp(header->Magic, "VTKMSHM1", 8) != 0 || header->Version != 1 ||
+        totalBytes > this->Size || totalBytes < sizeof(SharedHeader) ||
+        (totalBytes - sizeof(SharedHeader)) / sizeof(SharedArrayEntry) <
+            header->NumArrays)
+      return false;
+    const SharedArrayEntry *entries = reinterpret_cast<const SharedArrayEntry *>(
+        static_cast<const char *>(this->Mapping) + sizeof(SharedHeader));
+    for (vtkm::UInt32 i = 0; i < header->NumArrays; i++) {
+      const SharedArrayEntry &entry = entries[i];
+      if (memchr(entry.Name, '\0', sizeof(entry.Name)) == nullptr ||
+          entry.Role > SHARED_CELL_FIELD || entry.Type > SHARED_UINT8 ||
+          entry.NumComponents < 1 || entry.NumComponents > 3 ||
+          entry.Offset % 64 != 0 || entry.Offset > totalBytes)
+        return false;
+      vtkm::UInt64 valueBytes = entry.NumComponents * SharedValueSize(entry.Type);
+      if (entry.NumValues > (totalBytes - entry.Offset) / valueBytes)
+        return false;
+    }
+    return true;
+  }
+
+  const SharedArrayEntry *Require(vtkm::UInt32 role) const {
+    const SharedArrayEntry *entry = this->FindEntry(role);
+    if (entry == nullptr)
+      throw vtkm::cont::ErrorBadValue("Shared dataset is missing an array");
+    return entry;
+  }
+
+  template <typename ComponentType>
+  vtkm::cont::DynamicArrayHandle GetField(const SharedArrayEntry &entry) const {
+    switch (entry.NumComponents) {
+    case 1:
+      return this->GetArray<ComponentType>(entry);
+    case 2:
+      return this->GetArray<vtkm::Vec<ComponentType, 2>>(entry);
+    case 3:
+      return this->GetArray<vtkm::Vec<ComponentType, 3>>(entry);
+    default:
+      throw vtkm::cont::ErrorBadValue(std::string("Unexpected components for ") +
+                                      entry.Name);
+    }
+  }
+
+  vtkm::cont::DynamicArrayHandle GetField(const SharedArrayEntry &entry) const {
+    switch (entry.Type) {
+    case SHARED_FLOAT32:
+      return this->GetField<vtkm::Float32>(entry);
+    case SHARED_FLOAT64:
+      return this->GetField<vtkm::Float64>(entry);
+    case SHARED_INT32:
+      return this->GetField<vtkm::Int32>(entry);
+    case SHARED_INT64:
+      return this->GetField<vtkm::Int64>(entry);
+    default:
+      return this->GetField<vtkm::UInt8>(entry);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef SYNTHETIC_DATASET_H
+#define SYNTHETIC_DATASET_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include <vtkm/ListTag.h>
+#include <vtkm/cont/ArrayHandleImplicit.h>
+#include <vtkm/cont/ArrayHandleIndex.h>
+#include <vtkm/cont/CellSetStructured.h>
+#include <vtkm/cont/CoordinateSystem.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/ErrorBadValue.h>
+#include <vtkm/cont/StorageBasic.h>
+#include <vtkm/filter/PolicyBase.h>
+#include <vtkm/io/reader/VTKDataSetReader.h>
+
+#include "SyntheticFields.h"
+
+// Procedural datasets for scaling runs. A dataset spec of the form
+//
+//   synthetic:<shells|gradient|noise>:<nx>x<ny>x<nz>   (or :<n> for a cube)
+//
+// given in place of a file name builds a uniform grid over the unit cube whose
+// coordinates, cells, point field and "cellIds" are all implicit: nothing is
+// stored, values are computed when a worklet reads them, so only the clip
+// output takes memory.
+
+using ShellsArray =
+    decltype(vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(ShellsField(), 0));
+using GradientArray =
+    decltype(vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(GradientField(), 0));
+using NoiseArray =
+    decltype(vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(NoiseField(), 0));
+
+// Storage of every field a driver may meet: the basic storage of files and clip
+// outputs, plus the procedural fields and implicit cell ids.
+struct ImplicitFieldStorageList
+    : vtkm::ListTagBase<vtkm::cont::StorageTagBasic,
+                        typename ShellsArray::StorageTag,
+                        typename GradientArray::StorageTag,
+                        typename NoiseArray::StorageTag,
+                        typename vtkm::cont::ArrayHandleIndex::StorageTag> {};
+
+// Value types of the fields the drivers clip, classify and map: the scalars of
+// the default list, without its Vec types.
+struct ScalarFieldTypeList
+    : vtkm::ListTagBase<vtkm::Float32, vtkm::Float64, vtkm::Int32, vtkm::Int64> {};
+
+// Filters only cast fields to the types and storage listed in their policy,
+// so the drivers pass this one to Execute and MapFieldOntoOutput. Listing the
+// scalar types alone also keeps the filters from being compiled for Vecs.
+struct ImplicitFieldPolicy : vtkm::filter::PolicyBase<ImplicitFieldPolicy> {
+  using FieldTypeList = ScalarFieldTypeList;
+  using FieldStorageList = ImplicitFieldStorageList;
+};
+
+inline bool IsSyntheticSpec(const std::string &filename) {
+  return filename.compare(0, 10, "synthetic:") == 0;
+}
+
+inline vtkm::cont::DataSet MakeSyntheticDataSet(const std::string &spec,
+                                                const std::string &variable) {
+  size_t split = spec.find(':', 10);
+  if (split == std::string::npos)
+    throw vtkm::cont::ErrorBadValue("Expected synthetic:<field>:<dims>, got " + spec);
+  std::string fieldName = spec.substr(10, split - 10);
+  std::string dimString = spec.substr(split + 1);
+
+  vtkm::Id3 dims;
+  char *next = nullptr;
+  dims[0] = strtoll(dimString.c_str(), &next, 10);
+  dims[1] = (*next == 'x') ? strtoll(next + 1, &next, 10) : dims[0];
+  dims[2] = (*next == 'x') ? strtoll(next + 1, &next, 10) : dims[1];
+  if (dims[0] < 2 || dims[1] < 2 || dims[2] < 2)
+    throw vtkm::cont::ErrorBadValue("Synthetic datasets need at least 2 points per axis");
+  vtkm::Id numPoints = dims[0] * dims[1] * dims[2];
+
+  vtkm::cont::DataSet dataset;
+  vtkm::Vec<vtkm::FloatDefault, 3> origin(0, 0, 0);
+  vtkm::Vec<vtkm::FloatDefault, 3> spacing(
+      1.0f / static_cast<vtkm::FloatDefault>(dims[0] - 1),
+      1.0f / static_cast<vtkm::FloatDefault>(dims[1] - 1),
+      1.0f / static_cast<vtkm::FloatDefault>(dims[2] - 1));
+  dataset.AddCoordinateSystem(
+      vtkm::cont::CoordinateSystem("coordinates", dims, origin, spacing));
+
+  vtkm::cont::CellSetStructured<3> cellSet("cells");
+  cellSet.SetPointDimensions(dims);
+  dataset.AddCellSet(cellSet);
+
+  vtkm::cont::Field::AssociationEnum points = vtkm::cont::Field::ASSOC_POINTS;
+  if (fieldName == "shells")
+    dataset.AddField(vtkm::cont::Field(
+        variable, points,
+        vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(ShellsField(dims), numPoints)));
+  else if (fieldName == "gradient")
+    dataset.AddField(vtkm::cont::Field(
+        variable, points,
+        vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(GradientField(dims), numPoints)));
+  else if (fieldName == "noise")
+    dataset.AddField(vtkm::cont::Field(
+        variable, points,
+        vtkm::cont::make_ArrayHandleImplicit<vtkm::Float32>(NoiseField(dims), numPoints)));
+  else
+    throw vtkm::cont::ErrorBadValue("Unknown synthetic field " + fieldName);
+
+  vtkm::Id numCells = cellSet.GetNumberOfCells();
+  dataset.AddField(vtkm::cont::Field("cellIds", vtkm::cont::Field::ASSOC_CELL_SET,
+                                     cellSet.GetName(),
+                                     vtkm::cont::ArrayHandleIndex(numCells)));
+  return dataset;
+}
+
+// Reads a legacy VTK file, or builds the procedural dataset for a synthetic
+// spec with its point field named variable.
+inline vtkm::cont::DataSet LoadDataSet(const std::string &filename,
+                                       const std::string &variable) {
+  if (IsSyntheticSpec(filename))
+    return MakeSyntheticDataSet(filename, variable);
+  vtkm::io::reader::VTKDataSetReader reader(filename.c_str());
+  return reader.ReadDataSet();
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef SYNTHETIC_FIELDS_H
+#define SYNTHETIC_FIELDS_H
+
+#include <string>
+
+#include <vtkm/Math.h>
+#include <vtkm/Types.h>
+
+// Analytic scalar fields over the logical index space of a dims[0] x dims[1] x
+// dims[2] point grid. Each one is a pure function of the flat point index
+// (x fastest), so it can be evaluated in a worklet, in any order and in any
+// piece, and the expected classification of the cells against an isovalue
+// is known without reading the data back.
+
+// The original DataSetCreator pattern: 1 inside the nested box
+// x <= y < ny - x, x <= z < nz - x, 0 elsewhere.
+struct ShellsField {
+  vtkm::Id3 Dims;
+
+  VTKM_EXEC_CONT ShellsField(vtkm::Id3 dims = vtkm::Id3(1, 1, 1)) : Dims(dims) {}
+
+  VTKM_EXEC_CONT vtkm::Float32 operator()(vtkm::Id index) const {
+    vtkm::Id x = index % this->Dims[0];
+    vtkm::Id y = (index / this->Dims[0]) % this->Dims[1];
+    vtkm::Id z = index / (this->Dims[0] * this->Dims[1]);
+    bool inside = y >= x && y < this->Dims[1] - x && z >= x &&
+                  z < this->Dims[2] - x;
+    return inside ? 1.0f : 0.0f;
+  }
+};
+
+// Linear ramp from 0 to 1 along x.
+struct GradientField {
+  vtkm::Id3 Dims;
+
+  VTKM_EXEC_CONT GradientField(vtkm::Id3 dims = vtkm::Id3(1, 1, 1)) : Dims(dims) {}
+
+  VTKM_EXEC_CONT vtkm::Float32 operator()(vtkm::Id index) const {
+    vtkm::Id x = index % this->Dims[0];
+    return static_cast<vtkm::Float32>(x) /
+           static_cast<vtkm::Float32>(vtkm::Max(this->Dims[0] - 1, vtkm::Id(1)));
+  }
+};
+
+// Uncorrelated white noise in [0, 1) from an integer hash of the point index.
+struct NoiseField {
+  vtkm::Id3 Dims;
+
+  VTKM_EXEC_CONT NoiseField(vtkm::Id3 dims = vtkm::Id3(1, 1, 1)) : Dims(dims) {}
+
+  VTKM_EXEC_CONT vtkm::Float32 operator()(vtkm::Id index) const {
+    vtkm::UInt64 hash = static_cast<vtkm::UInt64>(index) + 0x9E3779B97F4A7C15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+    hash = hash ^ (hash >> 31);
+    return static_cast<vtkm::Float32>(hash >> 40) / 16777216.0f;
+  }
+};
+
+// Number of cells whose eight points are all above isoValue (kept whole by an
+// isovolume) and number with at least one point above it (inside plus cut),
+// using the same strict comparison as the case extraction. Noise only has an
+// expected value, from independent uniform samples.
+struct ExpectedCellCounts {
+  vtkm::Float64 Inside;
+  vtkm::Float64 Touched;
+};
+
+inline ExpectedCellCounts ExpectedCounts(const std::string &field,
+                                         vtkm::Id3 dims,
+                                         vtkm::Float32 isoValue) {
+  ExpectedCellCounts counts = {0, 0};
+  vtkm::Float64 numCells = static_cast<vtkm::Float64>(dims[0] - 1) *
+                           static_cast<vtkm::Float64>(dims[1] - 1) *
+                           static_cast<vtkm::Float64>(dims[2] - 1);
+  if (field == "gradient") {
+    GradientField gradient(dims);
+    vtkm::Float64 slab = numCells / static_cast<vtkm::Float64>(dims[0] - 1);
+    for (vtkm::Id x = 0; x < dims[0] - 1; x++) {
+      counts.Inside += (gradient(x) > isoValue) ? slab : 0;
+      counts.Touched += (gradient(x + 1) > isoValue) ? slab : 0;
+    }
+  } else if (field == "noise") {
+    vtkm::Float64 below = vtkm::Min(vtkm::Max(isoValue, 0.0f), 1.0f);
+    counts.Inside = numCells * vtkm::Pow(1.0 - below, 8.0);
+    counts.Touched = numCells * (1.0 - vtkm::Pow(below, 8.0));
+  } else if (field == "shells" && isoValue >= 0.0f && isoValue < 1.0f) {
+    // A cell in x layer i is all ones when its x = i + 1 face is, and has
+    // a one when its x = i face does. The ones of the x = i face span
+    // [i, n - i) along y and z, and touch the cells starting at i - 1 up to
+    // n - i - 1; once that range is empty no cell of the layer is touched.
+    for (vtkm::Id x = 0; x < dims[0] - 1; x++) {
+      vtkm::Id insideY = vtkm::Max(dims[1] - 2 * x - 3, vtkm::Id(0));
+      vtkm::Id insideZ = vtkm::Max(dims[2] - 2 * x - 3, vtkm::Id(0));
+      vtkm::Id touchedY =
+          (x < dims[1] - x)
+              ? vtkm::Min(dims[1] - x - 1, dims[1] - 2) - vtkm::Max(x - 1, vtkm::Id(0)) + 1
+              : 0;
+      vtkm::Id touchedZ =
+          (x < dims[2] - x)
+              ? vtkm::Min(dims[2] - x - 1, dims[2] - 2) - vtkm::Max(x - 1, vtkm::Id(0)) + 1
+              : 0;
+      counts.Inside += static_cast<vtkm::Float64>(insideY * insideZ);
+      counts.Touched += static_cast<vtkm::Float64>(touchedY * touchedZ);
+    }
+  } else {
+    counts.Inside = counts.Touched = -1;
+  }
+  return counts;
+}
+
+// The same counts by evaluating field at the eight points of every cell, to
+// cross-check ExpectedCounts on small grids.
+template <typename FieldType>
+ExpectedCellCounts CountCellsBruteForce(const FieldType &field, vtkm::Id3 dims,
+                                        vtkm::Float32 isoValue) {
+  ExpectedCellCounts counts = {0, 0};
+  for (vtkm::Id k = 0; k < dims[2] - 1; k++)
+    for (vtkm::Id j = 0; j < dims[1] - 1; j++)
+      for (vtkm::Id i = 0; i < dims[0] - 1; i++) {
+        int above = 0;
+        for (int corner = 0; corner < 8; corner++) {
+          vtkm::Id index = (i + (corner & 1)) +
+                           (j + ((corner >> 1) & 1)) * dims[0] +
+                           (k + ((corner >> 2) & 1)) * dims[0] * dims[1];
+          above += (field(index) > isoValue) ? 1 : 0;
+        }
+        counts.Inside += (above == 8) ? 1 : 0;
+        counts.Touched += (above > 0) ? 1 : 0;
+      }
+  return counts;
+}
+
+#endif
@@ -1,89 +1,238 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <map>
+#include <string>
 #include <vector>
-#include <cmath>
-
-#include <vtkm/cont/DataSet.h>
-#include <vtkm/cont/DataSetBuilderRectilinear.h>
-#include <vtkm/cont/DataSetFieldAdd.h>
-#include <vtkm/io/writer/VTKDataSetWriter.h>
-
-#define PARAMS 10
-
-int getIndexFromLogical(int x, int y, int z,
-                        vtkm::Vec<vtkm::Id, 3>& dims)
-{
-  // z*slice + y*width + x;
-  int sliceSize = dims[0]*dims[1];
-  int width = dims[0];
-  return z*sliceSize + y*width + x;
+
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/ArrayHandleIndex.h>
+#include <vtkm/cont/ArrayPortalToIterators.h>
+#include <vtkm/cont/Timer.h>
+#include <vtkm/cont/TryExecute.h>
+#include <vtkm/worklet/DispatcherMapField.h>
+#include <vtkm/worklet/WorkletMapField.h>
+
+#include "DeviceSelection.h"
+#include "SyntheticFields.h"
+
+#define PARAMS 11
+
+// Legacy binary files are big-endian, so the values are swapped on
+// little-endian hosts only.
+inline bool HostIsLittleEndian() {
+  const vtkm::UInt32 one = 1;
+  return *reinterpret_cast<const unsigned char *>(&one) == 1;
 }
 
-int populateFieldData(std::vector<vtkm::Float32>& fieldDataVector,
-                      vtkm::Vec<vtkm::Id, 3> &dims)
-{
-  for(int x = 0; x < dims[0]; x++)
-    for(int y = x; y < dims[1] - x; y++)
-      for(int z = x; z < dims[2] - x; z++)
-      {
-        int index = getIndexFromLogical(x,y,z,dims);
-        fieldDataVector[index] = 1;
-      }
+// Evaluates the field for one slab of points and stores it as big-endian
+// bits, ready to be written to a legacy binary file as is.
+template <typename FieldType>
+class PopulateFieldData : public vtkm::worklet::WorkletMapField {
+public:
+  typedef void ControlSignature(FieldIn<> index, FieldOut<> bits);
+  typedef void ExecutionSignature(_1, _2);
+
+  VTKM_CONT
+  PopulateFieldData(const FieldType &field, vtkm::Id offset, bool swapBytes)
+      : Field(field), Offset(offset), SwapBytes(swapBytes) {}
+
+  VTKM_EXEC void operator()(const vtkm::Id &index, vtkm::UInt32 &bits) const {
+    union {
+      vtkm::Float32 value;
+      vtkm::UInt32 raw;
+    } convert;
+    convert.value = this->Field(index + this->Offset);
+    if (!this->SwapBytes) {
+      bits = convert.raw;
+      return;
+    }
+    bits = (convert.raw >> 24) | ((convert.raw >> 8) & 0x0000FF00u) |
+           ((convert.raw << 8) & 0x00FF0000u) | (convert.raw << 24);
+  }
+
+private:
+  FieldType Field;
+  vtkm::Id Offset;
+  bool SwapBytes;
+};
+
+template <typename FieldType> struct PopulateSlab {
+  FieldType Field;
+  vtkm::Id Offset;
+  vtkm::Id NumValues;
+  vtkm::cont::ArrayHandle<vtkm::UInt32> Bits;
+
+  template <typename Device> bool operator()(Device) {
+    vtkm::cont::ArrayHandleIndex indices(this->NumValues);
+    PopulateFieldData<FieldType> worklet(this->Field, this->Offset,
+                                         HostIsLittleEndian());
+    vtkm::worklet::DispatcherMapField<PopulateFieldData<FieldType>, Device>(
+        worklet).Invoke(indices, this->Bits);
+    return true;
+  }
+};
+
+// Streams the field to the file slab by slab: a slab is evaluated in parallel
+// on the selected device while the previous one is being written, so only two
+// slabs are ever in memory. Returns 0, or the errno of the first short write,
+// which is taken on the writing thread since errno is per thread.
+template <typename FieldType>
+int writeFieldData(FILE *file, const FieldType &field, vtkm::Id3 dims,
+                   vtkm::Id slabPlanes) {
+  vtkm::Id planeSize = dims[0] * dims[1];
+  PopulateSlab<FieldType> slabs[2];
+  std::future<int> pendingWrite;
+  int current = 0;
+  for (vtkm::Id z = 0; z < dims[2]; z += slabPlanes) {
+    PopulateSlab<FieldType> &slab = slabs[current];
+    slab.Field = field;
+    slab.Offset = z * planeSize;
+    slab.NumValues = std::min(slabPlanes, dims[2] - z) * planeSize;
+    vtkm::cont::TryExecute(slab);
+    if (pendingWrite.valid()) {
+      int error = pendingWrite.get();
+      if (error != 0)
+        return error;
+    }
+    vtkm::cont::ArrayHandle<vtkm::UInt32> bits = slab.Bits;
+    pendingWrite = std::async(std::launch::async, [file, bits]() {
+      auto portal = bits.GetPortalConstControl();
+      size_t count = static_cast<size_t>(bits.GetNumberOfValues());
+      errno = 0;
+      if (fwrite(&(*vtkm::cont::ArrayPortalToIteratorBegin(portal)),
+                 sizeof(vtkm::UInt32), count, file) == count)
+        return 0;
+      return errno != 0 ? errno : EIO;
+    });
+    current = 1 - current;
+  }
+  return pendingWrite.valid() ? pendingWrite.get() : 0;
 }
 
 int main(int argc, char **argv) {
   if (argc < PARAMS) {
     std::cout << "Invalid number of parameters" << std::endl;
+    std::cout << "Usage : " << argv[0] << " <file> ox oy oz ex ey ez nx ny nz"
+              << " [--field=shells|gradient|noise] [--iso=value]"
+              << " [--slab=planes] [--device=serial|tbb|cuda]" << std::endl;
     exit(1);
   }
   // Where we write the dataset;
   std::string filename(argv[1]);
   std::string variable("myscalar");
 
-  int numParams = argc - 2;
-  float *params = new float[numParams];
-  for (int index = 0; index < numParams; index++)
-    params[index] = atof(argv[index + 2]);
+  std::vector<std::string> params;
+  std::map<std::string, std::string> options;
+  for (int index = 2; index < argc; index++) {
+    std::string arg(argv[index]);
+    if (arg.compare(0, 2, "--") == 0) {
+      size_t split = arg.find('=');
+      options[arg.substr(2, split - 2)] =
+          (split == std::string::npos) ? "" : arg.substr(split + 1);
+      continue;
+    }
+    params.push_back(arg);
+  }
+  if (params.size() < PARAMS - 2) {
+    std::cout << "Invalid number of parameters" << std::endl;
+    exit(1);
+  }
 
-  vtkm::Vec<vtkm::Float32, 3> origin(params[0], params[1], params[2]);
+  vtkm::Vec<vtkm::Float32, 3> origin(atof(params[0].c_str()),
+                                     atof(params[1].c_str()),
+                                     atof(params[2].c_str()));
 
-  vtkm::Vec<vtkm::Float32, 3> extremes(params[3], params[4], params[5]);
+  vtkm::Vec<vtkm::Float32, 3> extremes(atof(params[3].c_str()),
+                                       atof(params[4].c_str()),
+                                       atof(params[5].c_str()));
 
-  vtkm::Vec<vtkm::Id, 3> dims(params[6], params[7], params[8]);
+  // Dimensions are 64 bit, a 2048^3 volume has more than 2^31 points.
+  vtkm::Id3 dims(atoll(params[6].c_str()), atoll(params[7].c_str()),
+                 atoll(params[8].c_str()));
 
   vtkm::Vec<vtkm::Float32, 3> spacing(
       (extremes[0] - origin[0]) / (float)(dims[0] - 1),
       (extremes[1] - origin[1]) / (float)(dims[1] - 1),
       (extremes[2] - origin[2]) / (float)(dims[2] - 1));
 
-  std::vector<vtkm::Float32> xCords, yCords, zCords;
-  for (int index = 0; index < dims[0]; index++)
-    xCords.push_back(origin[0] + index * spacing[0]);
-  for (int index = 0; index < dims[1]; index++)
-    yCords.push_back(origin[1] + index * spacing[1]);
-  for (int index = 0; index < dims[2]; index++)
-    zCords.push_back(origin[2] + index * spacing[2]);
-
-  vtkm::cont::DataSetBuilderRectilinear dataSetBuilder;
-  vtkm::cont::DataSet dataset = dataSetBuilder.Create(xCords, yCords, zCords);
-
-  vtkm::Id numFields = dims[0] * dims[1] * dims[2];
-  std::vector<vtkm::Float32> fieldDataVector(numFields, 0.0f);
-
-  populateFieldData(fieldDataVector, dims);
-
-  vtkm::cont::ArrayHandle<vtkm::Float32> fieldDataHandle =
-      vtkm::cont::make_ArrayHandle(fieldDataVector);
-
-  // Add derived field to dataset.
-  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
-  datasetFieldAdder.AddPointField(dataset, variable, fieldDataHandle);
+  std::string fieldName = options.count("field") ? options["field"] : "shells";
+  std::string device = SelectDevice(options["device"]);
+  // About 16M points per slab unless asked otherwise.
+  vtkm::Id slabPlanes = options.count("slab")
+                            ? atoll(options["slab"].c_str())
+                            : std::max(vtkm::Id(1), (vtkm::Id(1) << 24) /
+                                                        (dims[0] * dims[1]));
+
+  vtkm::Id numPoints = dims[0] * dims[1] * dims[2];
+  std::cout << "Generating " << fieldName << " on " << dims[0] << " x "
+            << dims[1] << " x " << dims[2] << " (" << numPoints
+            << " points) on " << device << std::endl;
+
+  if (options.count("iso")) {
+    vtkm::Float32 isoValue = atof(options["iso"].c_str());
+    ExpectedCellCounts counts = ExpectedCounts(fieldName, dims, isoValue);
+    std::cout << "Expected cells inside : " << counts.Inside
+              << ", cut : " << counts.Touched - counts.Inside
+              << " for isovalue " << isoValue << std::endl;
+    // Small exact fields are also counted cell by cell.
+    if (numPoints <= (vtkm::Id(1) << 21) && fieldName != "noise" &&
+        counts.Inside >= 0) {
+      ExpectedCellCounts counted =
+          (fieldName == "gradient")
+              ? CountCellsBruteForce(GradientField(dims), dims, isoValue)
+              : CountCellsBruteForce(ShellsField(dims), dims, isoValue);
+      if (counted.Inside != counts.Inside || counted.Touched != counts.Touched) {
+        std::cerr << "Expected counts disagree with the brute-force count : "
+                  << "inside " << counted.Inside << ", cut "
+                  << counted.Touched - counted.Inside << std::endl;
+        exit(1);
+      }
+    }
+  }
 
-  std::cout << "Number of Fields " << dataset.GetNumberOfFields() << std::endl;
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Cannot open " << filename << std::endl;
+    exit(1);
+  }
+  fprintf(file, "# vtk DataFile Version 3.0\nsynthetic %s\nBINARY\n"
+                "DATASET STRUCTURED_POINTS\n"
+                "DIMENSIONS %lld %lld %lld\nORIGIN %g %g %g\nSPACING %g %g %g\n"
+                "POINT_DATA %lld\nSCALARS %s float 1\nLOOKUP_TABLE default\n",
+          fieldName.c_str(), static_cast<long long>(dims[0]),
+          static_cast<long long>(dims[1]), static_cast<long long>(dims[2]),
+          origin[0], origin[1], origin[2], spacing[0], spacing[1], spacing[2],
+          static_cast<long long>(numPoints), variable.c_str());
 
   std::cout << "writing the dataset into " << filename << std::endl;
-  vtkm::io::writer::VTKDataSetWriter writer(filename);
-  writer.WriteDataSet(dataset, static_cast<vtkm::Id>(0));
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
+  int error;
+  if (fieldName == "gradient")
+    error = writeFieldData(file, GradientField(dims), dims, slabPlanes);
+  else if (fieldName == "noise")
+    error = writeFieldData(file, NoiseField(dims), dims, slabPlanes);
+  else
+    error = writeFieldData(file, ShellsField(dims), dims, slabPlanes);
+  errno = 0;
+  if (error == 0 && (fputc('\n', file) == EOF || ferror(file)))
+    error = errno != 0 ? errno : EIO;
+  if (fclose(file) != 0 && error == 0)
+    error = errno != 0 ? errno : EIO;
+  if (error != 0) {
+    std::cerr << "Error writing " << filename << ": " << strerror(error)
+              << std::endl;
+    exit(1);
+  }
+
+  vtkm::Float64 seconds = timer.GetElapsedTime();
+  std::cout << "Time taken : " << seconds << " ("
+            << numPoints * sizeof(vtkm::Float32) / seconds / 1e9 << " GB/s)"
+            << std::endl;
 
   return 0;
 }
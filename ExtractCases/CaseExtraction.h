@@ -0,0 +1,818 @@
+#ifndef CASE_EXTRACTION_H
+#define CASE_EXTRACTION_H
+
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <vtkm/Math.h>
+#include <vtkm/cont/ArrayHandleIndex.h>
+#include <vtkm/cont/ArrayPortalToIterators.h>
+#include <vtkm/cont/CellSetExplicit.h>
+#include <vtkm/cont/CellSetPermutation.h>
+#include <vtkm/cont/CellSetSingleType.h>
+#include <vtkm/cont/DataSet.h>
+#include <vtkm/cont/DataSetFieldAdd.h>
+#include <vtkm/cont/Timer.h>
+#include <vtkm/cont/TryExecute.h>
+#include <vtkm/filter/ClipWithField.h>
+#include <vtkm/filter/Threshold.h>
+#include <vtkm/worklet/CellDeepCopy.h>
+#include <vtkm/worklet/DispatcherMapField.h>
+#include <vtkm/worklet/DispatcherMapTopology.h>
+#include <vtkm/worklet/WorkletMapField.h>
+#include <vtkm/worklet/WorkletMapTopology.h>
+
+#include "ArrayPool.h"
+#include "BoundedQueue.h"
+#include "DeviceSelection.h"
+#include "SimdClassification.h"
+#include "SyntheticDataSet.h"
+
+// The case extraction pipeline shared by caseextractor and distributedclip:
+// cells are bucketed by the number of edges the isosurface cuts, and the
+// buckets are clipped concurrently.
+
+using clipping_futures = std::vector<std::future<bool>>;
+
+using ExplicitType =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetExplicit<>>;
+using ExplicitSingleType =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetSingleType<>>;
+using Structured2d =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetStructured<2>>;
+using Structured3d =
+    vtkm::cont::CellSetPermutation<vtkm::cont::CellSetStructured<3>>;
+
+template <typename CellSetType> struct DeepCopy {
+  const CellSetType &m_input;
+  vtkm::cont::CellSetExplicit<> &m_output;
+
+  DeepCopy(CellSetType &input, vtkm::cont::CellSetExplicit<> &output)
+      : m_input(input), m_output(output) {}
+
+  template <typename Device> bool operator()(Device device) {
+    m_output = vtkm::worklet::CellDeepCopy::Run(m_input, Device());
+    return true;
+  }
+};
+
+// Worklets that compare field values are templated on the value type of the
+// field, resolved once per call (see ComputeCases), so the comparison is done
+// in that type rather than in Float32.
+template <typename FieldType>
+class GetCases : public vtkm::worklet::WorkletMapPointToCell {
+public:
+  VTKM_CONT
+  GetCases(FieldType isoValue) : Value(isoValue) {}
+
+  typedef void ControlSignature(CellSetIn, FieldInPoint<>, FieldOut<>);
+  typedef void ExecutionSignature(CellShape, PointCount, _2, _3);
+
+  template <typename CellShapeTag, typename PointCountType,
+            typename FieldVecType, typename CaseIdType>
+  VTKM_EXEC void operator()(CellShapeTag shape, PointCountType pointCount,
+                            FieldVecType &fieldData, CaseIdType &caseId) const {
+    (void)shape; // C4100 false positive workaround
+    const vtkm::Id mask[] = {1, 2, 4, 8, 16, 32, 64, 128};
+    caseId = 0;
+    for (int i = 0; i < pointCount; ++i) {
+      caseId |= (fieldData[i] > this->Value) ? mask[i] : 0;
+    }
+  }
+
+private:
+  FieldType Value;
+};
+
+// First stage of the packed classifier: one pass over the point field that
+// stores the comparison of 32 consecutive points per word, so that the cell
+// stage reads a bit instead of a value for each of its corners.
+template <typename FieldType>
+class PackPointMask : public vtkm::worklet::WorkletMapField {
+public:
+  VTKM_CONT
+  PackPointMask(FieldType isoValue) : Value(isoValue) {}
+
+  typedef void ControlSignature(FieldIn<IdType>, WholeArrayIn<>, FieldOut<>);
+  typedef void ExecutionSignature(_1, _2, _3);
+
+  template <typename FieldPortalType>
+  VTKM_EXEC void operator()(const vtkm::Id &word, const FieldPortalType &field,
+                            vtkm::UInt32 &mask) const {
+    vtkm::Id first = 32 * word;
+    vtkm::Id count = vtkm::Min(vtkm::Id(32), field.GetNumberOfValues() - first);
+    mask = 0;
+    for (vtkm::Id i = 0; i < count; i++)
+      mask |= (field.Get(first + i) > this->Value) ? (vtkm::UInt32(1) << i) : 0;
+  }
+
+private:
+  FieldType Value;
+};
+
+// The isovalue in the value type of the field. Integer fields compare against
+// its floor, so that value > isoValue holds for the same values as in floating
+// point.
+template <typename FieldType>
+FieldType FieldIsoValue(vtkm::Float32 isoValue) {
+  return std::is_integral<FieldType>::value
+             ? static_cast<FieldType>(vtkm::Floor(isoValue))
+             : static_cast<FieldType>(isoValue);
+}
+
+// Second stage: the case of a cell from the mask bits of its points, in the
+// same corner order as GetCases.
+class CasesFromPointMask : public vtkm::worklet::WorkletMapPointToCell {
+public:
+  typedef void ControlSignature(CellSetIn, WholeArrayIn<>, FieldOut<>);
+  typedef void ExecutionSignature(PointCount, PointIndices, _2, _3);
+
+  template <typename PointCountType, typename IndicesVecType,
+            typename MaskPortalType, typename CaseIdType>
+  VTKM_EXEC void operator()(PointCountType pointCount,
+                            const IndicesVecType &pointIds,
+                            const MaskPortalType &mask,
+                            CaseIdType &caseId) const {
+    caseId = 0;
+    for (int i = 0; i < pointCount; ++i) {
+      vtkm::Id pointId = pointIds[i];
+      caseId |= static_cast<CaseIdType>((mask.Get(pointId >> 5) >> (pointId & 31)) & 1)
+                << i;
+    }
+  }
+};
+
+inline int CalculateAffectedEdges(std::vector<vtkm::Id> &caseToEdge) {
+  const int edges[12][2] = {{0, 1}, {1, 3}, {2, 3}, {0, 2}, {4, 5}, {5, 7},
+                            {6, 7}, {4, 6}, {0, 4}, {1, 5}, {3, 7}, {2, 6}};
+
+  for (int i = 0; i < 255; i++) {
+    std::bitset<8> casebits(i);
+    std::set<int> affectededges;
+    for (int edgeind = 0; edgeind < 12; edgeind++) {
+      int end1 = edges[edgeind][0];
+      int end2 = edges[edgeind][1];
+      if ((casebits[end1] == 1 && casebits[end2] == 0) ||
+          (casebits[end2] == 1 && casebits[end1] == 0))
+        affectededges.insert(edgeind);
+    }
+    caseToEdge.push_back(affectededges.size());
+  }
+  caseToEdge.push_back(-1);
+  return 0;
+}
+
+template <typename DeviceAdapterTag>
+class GetAffectedEdgesCount : public vtkm::worklet::WorkletMapField {
+
+private:
+  using CaseToEdgePortal = typename vtkm::cont::ArrayHandle<
+      vtkm::Id>::template ExecutionTypes<DeviceAdapterTag>::PortalConst;
+
+public:
+  typedef void ControlSignature(FieldIn<>, FieldOut<>);
+  typedef void ExecutionSignature(_1, _2);
+  CaseToEdgePortal caseToEdgePortal;
+
+  VTKM_CONT
+  GetAffectedEdgesCount(vtkm::cont::ArrayHandle<vtkm::Id> caseToEdge) {
+    caseToEdgePortal = caseToEdge.PrepareForInput(DeviceAdapterTag());
+  }
+
+  VTKM_EXEC void operator()(vtkm::Id caseId, vtkm::Id &numOfEdges) const {
+    numOfEdges = caseToEdgePortal.Get(caseId);
+  }
+};
+
+// Point fields as the classifiers see them: scalar values, in the storage of
+// files, clip outputs or synthetic datasets.
+using ImplicitFieldHandle =
+    vtkm::cont::DynamicArrayHandleBase<ScalarFieldTypeList,
+                                       ImplicitFieldStorageList>;
+
+inline ImplicitFieldHandle GetScalarField(const vtkm::cont::DataSet &dataset,
+                                          const std::string &variable) {
+  return dataset.GetPointField(variable).GetData().ResetTypeAndStorageLists(
+      ScalarFieldTypeList(), ImplicitFieldStorageList());
+}
+
+// ComputeCases once the field is cast to its actual array type.
+template <typename Device> struct ComputeCasesForField {
+  const vtkm::cont::DynamicCellSet &m_cellSet;
+  vtkm::Float32 m_isoValue;
+  const std::string &m_classifier;
+  vtkm::cont::ArrayHandle<vtkm::Id> &m_cases;
+  std::string &m_method;
+
+  ComputeCasesForField(const vtkm::cont::DynamicCellSet &cellSet,
+                       vtkm::Float32 isoValue, const std::string &classifier,
+                       vtkm::cont::ArrayHandle<vtkm::Id> &cases,
+                       std::string &method)
+      : m_cellSet(cellSet), m_isoValue(isoValue), m_classifier(classifier),
+        m_cases(cases), m_method(method) {}
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &field) const {
+    std::string deviceName = LowerCase(DeviceName(Device()));
+    if (m_classifier == "simd" && deviceName != "cuda") {
+      int workers = (deviceName == "serial") ? 1 : HostThreads();
+      if (ClassifyStructuredCells(m_cellSet, field, m_isoValue, m_cases,
+                                  workers)) {
+        m_method = "simd " + SimdInstructionSet();
+        return;
+      }
+    }
+    T isoValue = FieldIsoValue<T>(m_isoValue);
+    if (m_classifier == "worklet") {
+      GetCases<T> extractCases(isoValue);
+      vtkm::worklet::DispatcherMapTopology<GetCases<T>, Device>
+          extractCasesWorklet(extractCases);
+      extractCasesWorklet.Invoke(m_cellSet, field, m_cases);
+      m_method = "worklet";
+      return;
+    }
+    vtkm::Id numWords = (field.GetNumberOfValues() + 31) / 32;
+    vtkm::cont::ArrayHandle<vtkm::UInt32> pointMask =
+        ArrayPool::Global().Acquire<vtkm::UInt32>(numWords);
+    PackPointMask<T> packMask(isoValue);
+    vtkm::worklet::DispatcherMapField<PackPointMask<T>, Device>(packMask).Invoke(
+        vtkm::cont::ArrayHandleIndex(numWords), field, pointMask);
+    vtkm::worklet::DispatcherMapTopology<CasesFromPointMask, Device>().Invoke(
+        m_cellSet, pointMask, m_cases);
+    ArrayPool::Global().Release(pointMask);
+    m_method = "packed";
+  }
+};
+
+// Cases of every cell into cases with the named classifier:
+//   worklet  GetCases, which reads the field at every corner of every cell;
+//   packed   PackPointMask then CasesFromPointMask, one read per point;
+//   simd     the host SIMD kernels for structured grids over stored Float32
+//            fields on the CPU devices, packed otherwise.
+// The field is cast to its value type and storage once, here. Returns the
+// method actually used.
+template <typename Device>
+std::string ComputeCases(const vtkm::cont::DynamicCellSet &cellSet,
+                         const ImplicitFieldHandle &fieldData,
+                         vtkm::Float32 isoValue, const std::string &classifier,
+                         vtkm::cont::ArrayHandle<vtkm::Id> &cases, Device) {
+  std::string method;
+  fieldData.CastAndCall(
+      ComputeCasesForField<Device>(cellSet, isoValue, classifier, cases, method));
+  return method;
+}
+
+// Computes the case of every cell and the number of edges it cuts, on
+// whichever device the runtime tracker allows.
+struct ClassifyCells {
+  vtkm::cont::DynamicCellSet CellSet;
+  ImplicitFieldHandle FieldData;
+  vtkm::Float32 IsoValue;
+  std::string Classifier = "packed";
+  vtkm::cont::ArrayHandle<vtkm::Id> CaseToEdge;
+  vtkm::cont::ArrayHandle<vtkm::Id> NumAffectedEdges;
+  std::string Device;
+  std::string Method;
+
+  template <typename Device> bool operator()(Device device) {
+    vtkm::Id numCells = this->CellSet.GetNumberOfCells();
+    vtkm::cont::ArrayHandle<vtkm::Id> caseArray =
+        ArrayPool::Global().Acquire<vtkm::Id>(numCells);
+    this->NumAffectedEdges = ArrayPool::Global().Acquire<vtkm::Id>(numCells);
+    this->Method = ComputeCases(this->CellSet, this->FieldData, this->IsoValue,
+                                this->Classifier, caseArray, device);
+
+    GetAffectedEdgesCount<Device> getEdges(this->CaseToEdge);
+    vtkm::worklet::DispatcherMapField<GetAffectedEdgesCount<Device>, Device>
+        getEdgeWorklet(getEdges);
+    getEdgeWorklet.Invoke(caseArray, this->NumAffectedEdges);
+    ArrayPool::Global().Release(caseArray);
+    this->Device = DeviceName(device);
+    return true;
+  }
+};
+
+// Times every classifier on the same input and counts the cells where each
+// disagrees with the GetCases worklet.
+struct CompareClassification {
+  vtkm::cont::DynamicCellSet CellSet;
+  ImplicitFieldHandle FieldData;
+  vtkm::Float32 IsoValue;
+  std::vector<std::string> Methods;
+  std::vector<vtkm::Float64> Times;
+  std::vector<vtkm::Id> Mismatches;
+
+  template <typename Device> bool operator()(Device device) {
+    const std::string classifiers[] = {"worklet", "packed", "simd"};
+    vtkm::Id numCells = this->CellSet.GetNumberOfCells();
+    vtkm::cont::ArrayHandle<vtkm::Id> reference;
+    this->Methods.clear();
+    this->Times.clear();
+    this->Mismatches.clear();
+    for (const std::string &classifier : classifiers) {
+      vtkm::cont::ArrayHandle<vtkm::Id> cases;
+      cases.Allocate(numCells);
+      vtkm::cont::Timer<Device> timer;
+      std::string method = ComputeCases(this->CellSet, this->FieldData,
+                                        this->IsoValue, classifier, cases, device);
+      this->Times.push_back(timer.GetElapsedTime());
+      this->Methods.push_back(method);
+      if (classifier == "worklet")
+        reference = cases;
+      auto referencePortal = reference.GetPortalConstControl();
+      auto casePortal = cases.GetPortalConstControl();
+      vtkm::Id mismatches = 0;
+      for (vtkm::Id i = 0; i < numCells; i++)
+        mismatches += referencePortal.Get(i) != casePortal.Get(i);
+      this->Mismatches.push_back(mismatches);
+    }
+    return true;
+  }
+};
+
+// Prints the time of every classifier and its throughput, counting the field
+// values read and the cases written.
+inline void BenchmarkClassification(vtkm::cont::DataSet &dataset,
+                                    const std::string &variable,
+                                    vtkm::Float32 isoValue) {
+  CompareClassification compare;
+  compare.CellSet = dataset.GetCellSet(0);
+  compare.FieldData = GetScalarField(dataset, variable);
+  compare.IsoValue = isoValue;
+  vtkm::cont::TryExecute(compare);
+  vtkm::Float64 gigaBytes =
+      static_cast<vtkm::Float64>(compare.CellSet.GetNumberOfPoints() *
+                                     sizeof(vtkm::Float32) +
+                                 compare.CellSet.GetNumberOfCells() *
+                                     sizeof(vtkm::Id)) / 1e9;
+  for (size_t i = 0; i < compare.Methods.size(); i++)
+    std::cout << "Time taken for classification (" << compare.Methods[i]
+              << ") : " << compare.Times[i] << " ("
+              << gigaBytes / compare.Times[i] << " GB/s, "
+              << compare.Mismatches[i] << " mismatches)" << std::endl;
+}
+
+// Clips input at isoVal, mapping variable and, when given, the cell field
+// cellField (such as the original cell ids) onto the output.
+inline bool performTrivialIsoVolume(vtkm::cont::DataSet &input,
+                                    const std::string variable,
+                                    const vtkm::Float32 isoVal,
+                                    vtkm::cont::DataSet &output,
+                                    const std::string cellField = "") {
+  vtkm::filter::Result result;
+  vtkm::filter::ClipWithField filter;
+  // Apply clip isoVal.
+  filter.SetClipValue(isoVal);
+  filter.SetActiveField(variable);
+
+  // The policy lets the filter read procedural fields as well as stored ones.
+  ImplicitFieldPolicy policy;
+  result = filter.Execute(input, variable, policy);
+  filter.MapFieldOntoOutput(result, input.GetPointField(variable), policy);
+  if (!cellField.empty())
+    filter.MapFieldOntoOutput(result, input.GetCellField(cellField), policy);
+
+  // Output of clip.
+  output = result.GetDataSet();
+  return true;
+}
+
+inline void LaunchClippingThreads(std::vector<vtkm::cont::DataSet> &dataIn,
+                                  const std::string variable,
+                                  const vtkm::Float32 isoVal,
+                                  std::vector<vtkm::cont::DataSet> &dataOut,
+                                  int startPosition,
+                                  int chunkSize,
+                                  const std::string cellField = "") {
+  clipping_futures futures;
+  // begin timing
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> clipTimer;
+  for (int i = startPosition; i < startPosition + chunkSize; i++) {
+    //std::cout << "Launching thread : " << i << std::endl;
+    futures.push_back(std::async(std::launch::async,
+                                 performTrivialIsoVolume,
+                                 std::ref(dataIn[i]),
+                                 variable,
+                                 isoVal,
+                                 std::ref(dataOut[i]),
+                                 cellField));
+  }
+  //Sync and end all threads in the current phase.
+  for (int i = 0; i < chunkSize; i++) {
+    //std::cout << "Getting future : " << i << std::endl;
+    if(!futures[i].get())
+    {
+      std::cerr << "Error occured in syncing thread" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  /*for (int i = startPosition; i < startPosition + chunkSize; i++) {
+    performTrivialIsoVolume(std::ref(dataIn[i]), variable, isoVal, std::ref(dataOut[i]));
+  }*/
+
+}
+
+inline int CastCellSet(vtkm::cont::DataSet& input,
+                       vtkm::cont::DataSet& output) {
+  vtkm::cont::DynamicCellSet cellSet = input.GetCellSet();
+  vtkm::cont::CellSetExplicit<> explicitCellSet;
+  if (cellSet.IsSameType(ExplicitType())) {
+    ExplicitType explicitType = cellSet.Cast<ExplicitType>();
+    DeepCopy<ExplicitType> functor(explicitType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else if (cellSet.IsSameType(ExplicitSingleType())) {
+    ExplicitSingleType explicitType = cellSet.Cast<ExplicitSingleType>();
+    DeepCopy<ExplicitSingleType> functor(explicitType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else if (cellSet.IsSameType(Structured2d())) {
+    Structured2d structuredType = cellSet.Cast<Structured2d>();
+    DeepCopy<Structured2d> functor(structuredType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else if (cellSet.IsSameType(Structured3d())) {
+    Structured3d structuredType = cellSet.Cast<Structured3d>();
+    DeepCopy<Structured3d> functor(structuredType, explicitCellSet);
+    vtkm::cont::TryExecute(functor);
+  } else {
+    output = input;
+    return 0;
+  }
+  output.AddCellSet(explicitCellSet);
+  vtkm::Id numCoordSys = input.GetNumberOfCoordinateSystems();
+  for (vtkm::Id ind = 0; ind < numCoordSys; ind++)
+    output.AddCoordinateSystem(input.GetCoordinateSystem(ind));
+  vtkm::Id numFields = input.GetNumberOfFields();
+  for (vtkm::Id ind = 0; ind < numFields; ind++)
+    output.AddField(input.GetField(ind));
+
+  return 0;
+}
+
+inline bool ApplyThresholdFilter(vtkm::cont::DataSet& dataset,
+                                vtkm::Id lowerThreshold,
+                                vtkm::Id upperThreshold,
+                                const std::string mapVariable,
+                                const std::string thresholdVariable,
+                                vtkm::cont::DataSet& bucket,
+                                const std::string cellField = "")
+{
+  vtkm::filter::Threshold thresholdFilter;
+  vtkm::filter::Result result;
+  thresholdFilter = vtkm::filter::Threshold();
+
+  thresholdFilter.SetLowerThreshold(lowerThreshold);
+  thresholdFilter.SetUpperThreshold(upperThreshold);
+  thresholdFilter.SetActiveField(thresholdVariable);
+
+  ImplicitFieldPolicy policy;
+  result = thresholdFilter.Execute(dataset, thresholdVariable, policy);
+  thresholdFilter.MapFieldOntoOutput(result, dataset.GetPointField(mapVariable),
+                                     policy);
+  if (!cellField.empty())
+    thresholdFilter.MapFieldOntoOutput(result, dataset.GetCellField(cellField),
+                                       policy);
+
+  CastCellSet(result.GetDataSet(), bucket);
+
+  return true;
+}
+
+// Starts the threshold of every bucket on its own thread and returns their
+// futures, in bucket order. The buckets carry mapVariable and cellField, if
+// any.
+inline clipping_futures LaunchThresholds(vtkm::cont::DataSet& dataset,
+                                         const std::string mapVariable,
+                                         const std::string thresholdVariable,
+                                         std::vector<vtkm::cont::DataSet>& dataIn,
+                                         const std::string cellField = "")
+{
+  clipping_futures futures;
+  // Every bucket has its own slot, so the order is fixed and the cells with
+  // no cut edge (the pass-through bucket) always come last.
+  dataIn.resize(5);
+
+  futures.push_back(std::async(std::launch::async, ApplyThresholdFilter,
+                               std::ref(dataset), 7, 12, mapVariable,
+                               thresholdVariable, std::ref(dataIn[0]),
+                               cellField));
+
+  futures.push_back(std::async(std::launch::async, ApplyThresholdFilter,
+                               std::ref(dataset), 5, 6, mapVariable,
+                               thresholdVariable, std::ref(dataIn[1]),
+                               cellField));
+
+  futures.push_back(std::async(std::launch::async, ApplyThresholdFilter,
+                               std::ref(dataset), 4, 4, mapVariable,
+                               thresholdVariable, std::ref(dataIn[2]),
+                               cellField));
+
+  futures.push_back(std::async(std::launch::async, ApplyThresholdFilter,
+                               std::ref(dataset), 3, 3, mapVariable,
+                               thresholdVariable, std::ref(dataIn[3]),
+                               cellField));
+
+  futures.push_back(std::async(std::launch::async, ApplyThresholdFilter,
+                               std::ref(dataset), -1, -1, mapVariable,
+                               thresholdVariable, std::ref(dataIn[4]),
+                               cellField));
+
+  /*ApplyThresholdFilter(dataset, 7, 12, variable, countVar, dataIn);
+  ApplyThresholdFilter(dataset, 5, 6, variable, countVar, dataIn);
+  ApplyThresholdFilter(dataset, 4, 4, variable, countVar, dataIn);
+  ApplyThresholdFilter(dataset, 3, 3, variable, countVar, dataIn);
+  ApplyThresholdFilter(dataset, -1, -1, variable, countVar, dataIn);*/
+  return futures;
+}
+
+inline void WaitForBucket(clipping_futures& futures, size_t bucket)
+{
+  if(!futures[bucket].get())
+  {
+    std::cerr << "Error occured in syncing thread" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+inline int ApplyThresholdToDataSet(vtkm::cont::DataSet& dataset,
+                                   const std::string mapVariable,
+                                   const std::string thresholdVariable,
+                                   std::vector<vtkm::cont::DataSet>& dataIn,
+                                   const std::string cellField = "")
+{
+  clipping_futures futures = LaunchThresholds(dataset, mapVariable,
+                                              thresholdVariable, dataIn, cellField);
+  //Sync and end all threads in the current phase.
+  for (size_t i = 0; i < futures.size(); i++)
+    WaitForBucket(futures, i);
+  return 0;
+}
+
+// Brings an array back to the host.
+struct SyncArrayToHost {
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &array) const {
+    array.GetPortalConstControl();
+  }
+};
+
+// Moves the cells, coordinates and field of a bucket to the device, so that
+// its clip finds them there. Arrays the bucket shares with others, such as
+// the coordinates, are only transferred the first time.
+struct UploadBucket {
+  const vtkm::cont::DataSet &m_bucket;
+  const std::string &m_variable;
+
+  UploadBucket(const vtkm::cont::DataSet &bucket, const std::string &variable)
+      : m_bucket(bucket), m_variable(variable) {}
+
+  template <typename Device> bool operator()(Device) {
+    vtkm::cont::DynamicCellSet cellSet = m_bucket.GetCellSet(0);
+    if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>()))
+      cellSet.Cast<vtkm::cont::CellSetExplicit<>>().PrepareForInput(
+          Device(), vtkm::TopologyElementTagPoint(),
+          vtkm::TopologyElementTagCell());
+    m_bucket.GetCoordinateSystem().GetData().CastAndCall(
+        PrepareArrayForInput<Device>());
+    GetScalarField(m_bucket, m_variable).CastAndCall(
+        PrepareArrayForInput<Device>());
+    return true;
+  }
+};
+
+// Copies a clip output back to the host.
+inline void DownloadBucket(const vtkm::cont::DataSet &bucket,
+                           const std::string &variable) {
+  vtkm::cont::DynamicCellSet cellSet = bucket.GetCellSet(0);
+  if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>())) {
+    auto explicitSet = cellSet.Cast<vtkm::cont::CellSetExplicit<>>();
+    vtkm::TopologyElementTagPoint point;
+    vtkm::TopologyElementTagCell cell;
+    explicitSet.GetShapesArray(point, cell).GetPortalConstControl();
+    explicitSet.GetNumIndicesArray(point, cell).GetPortalConstControl();
+    explicitSet.GetConnectivityArray(point, cell).GetPortalConstControl();
+  }
+  bucket.GetCoordinateSystem().GetData().CastAndCall(SyncArrayToHost());
+  GetScalarField(bucket, variable).CastAndCall(SyncArrayToHost());
+}
+
+struct OverlapTimes {
+  // Seconds each stage was busy; with overlap their sum exceeds the wall time.
+  vtkm::Float64 Upload;
+  vtkm::Float64 Clip;
+  vtkm::Float64 Download;
+  vtkm::Float64 Wall;
+};
+
+// Clips the cut buckets of dataIn as a pipeline of three stages on their own
+// threads: an uploader that takes each bucket as soon as its threshold is done
+// and moves it to the device, clipWorkers threads that clip the uploaded
+// buckets, and a downloader that copies each output back to the host. Bucket
+// k+1 is thus uploaded while bucket k is clipped and the output of bucket k-1
+// is downloaded. The queues between the stages hold at most clipWorkers
+// buckets, which bounds the device memory. On CUDA the stages overlap when
+// every host thread has its own default stream (--default-stream per-thread);
+// on the host devices they are simply concurrent tasks.
+inline OverlapTimes ClipBucketsOverlapped(clipping_futures &thresholds,
+                                          std::vector<vtkm::cont::DataSet> &dataIn,
+                                          const std::string &variable,
+                                          vtkm::Float32 isoValue,
+                                          std::vector<vtkm::cont::DataSet> &dataOut,
+                                          int clipWorkers,
+                                          const std::string &cellField = "") {
+  // Device timers would synchronize the whole device, so the stages are timed
+  // on the host clock.
+  using Clock = std::chrono::steady_clock;
+  auto seconds = [](Clock::time_point start) {
+    return std::chrono::duration<vtkm::Float64>(Clock::now() - start).count();
+  };
+  OverlapTimes times = {0, 0, 0, 0};
+  Clock::time_point start = Clock::now();
+  size_t numCut = dataIn.size() - 1;
+  dataOut.clear();
+  dataOut.resize(dataIn.size());
+  clipWorkers = std::max(1, clipWorkers);
+  BoundedQueue<size_t> uploaded(static_cast<size_t>(clipWorkers));
+  BoundedQueue<size_t> clipped(static_cast<size_t>(clipWorkers));
+
+  // The first error of any stage cancels both queues, which releases the
+  // stages blocked on them, and is rethrown once all of them are joined.
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  auto fail = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if (!error)
+        error = std::current_exception();
+    }
+    uploaded.Cancel();
+    clipped.Cancel();
+  };
+
+  std::thread uploader([&]() {
+    try {
+      for (size_t k = 0; k < numCut; k++) {
+        WaitForBucket(thresholds, k);
+        Clock::time_point begin = Clock::now();
+        UploadBucket upload(dataIn[k], variable);
+        vtkm::cont::TryExecute(upload);
+        times.Upload += seconds(begin);
+        if (!uploaded.Push(k))
+          break;
+      }
+    } catch (...) {
+      fail();
+    }
+    uploaded.Close();
+  });
+
+  std::thread downloader([&]() {
+    try {
+      size_t k;
+      while (clipped.Pop(k)) {
+        Clock::time_point begin = Clock::now();
+        DownloadBucket(dataOut[k], variable);
+        times.Download += seconds(begin);
+      }
+    } catch (...) {
+      fail();
+    }
+  });
+
+  std::mutex clipMutex;
+  auto clipWorker = [&]() {
+    try {
+      size_t k;
+      while (uploaded.Pop(k)) {
+        Clock::time_point begin = Clock::now();
+        performTrivialIsoVolume(dataIn[k], variable, isoValue, dataOut[k],
+                                cellField);
+        {
+          std::lock_guard<std::mutex> lock(clipMutex);
+          times.Clip += seconds(begin);
+        }
+        if (!clipped.Push(k))
+          break;
+      }
+    } catch (...) {
+      fail();
+    }
+  };
+  std::vector<std::future<void>> workers;
+  for (int i = 0; i < clipWorkers; i++)
+    workers.push_back(std::async(std::launch::async, clipWorker));
+  for (auto &worker : workers)
+    worker.get();
+  clipped.Close();
+  uploader.join();
+  downloader.join();
+  if (error)
+    std::rethrow_exception(error);
+
+  // The pass-through bucket needs no clip.
+  WaitForBucket(thresholds, numCut);
+  dataOut[numCut] = dataIn[numCut];
+  times.Wall = seconds(start);
+  return times;
+}
+
+struct CaseExtractionTimes {
+  vtkm::Float64 Threshold;
+  vtkm::Float64 Clip;
+};
+
+// The whole bucketed isovolume: classifies the cells of dataset, splits them
+// into buckets by the number of edges they cut, and clips the buckets
+// phases at a time. dataIn receives the buckets and dataOut their clipped
+// counterparts, the last one being the cells kept whole. classifier names
+// the classification method, see ComputeCases. With overlap the buckets go
+// through ClipBucketsOverlapped instead, with phases clip workers. A
+// cellField, such as the original cell ids, is carried through to dataOut.
+inline CaseExtractionTimes
+ExtractCasesAndClip(vtkm::cont::DataSet &dataset, const std::string &variable,
+                    vtkm::Float32 isoValue, int phases,
+                    std::vector<vtkm::cont::DataSet> &dataIn,
+                    std::vector<vtkm::cont::DataSet> &dataOut,
+                    const std::string &classifier = "packed",
+                    bool overlap = false,
+                    const std::string &cellField = "") {
+  CaseExtractionTimes times;
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> thresholdTimer;
+
+  // Synthetic fields are implicit arrays, outside the default storage list.
+  ClassifyCells classify;
+  classify.CellSet = dataset.GetCellSet(0);
+  classify.FieldData = GetScalarField(dataset, variable);
+  classify.IsoValue = isoValue;
+  classify.Classifier = classifier;
+
+  std::vector<vtkm::Id> caseToEdge;
+  CalculateAffectedEdges(caseToEdge);
+  classify.CaseToEdge = vtkm::cont::make_ArrayHandle(caseToEdge);
+  vtkm::cont::TryExecute(classify);
+  std::cout << "Classification method : " << classify.Method << std::endl;
+  vtkm::cont::ArrayHandle<vtkm::Id> numAffectedEdges = classify.NumAffectedEdges;
+
+  // The counts go on a copy of the dataset, so that no field of the caller's
+  // dataset aliases the pooled buffer once it is released below. The buckets
+  // map only variable and cellField.
+  const std::string countVar("afEdgeCount");
+  vtkm::cont::DataSet classified = dataset;
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  datasetFieldAdder.AddCellField(classified, countVar, numAffectedEdges);
+
+  if (overlap) {
+    // The buckets are clipped as their thresholds finish, so the threshold
+    // time is the classification alone and the rest counts as clip time.
+    clipping_futures thresholds =
+        LaunchThresholds(classified, variable, countVar, dataIn, cellField);
+    times.Threshold = thresholdTimer.GetElapsedTime();
+    OverlapTimes stages = ClipBucketsOverlapped(thresholds, dataIn, variable,
+                                                isoValue, dataOut, phases,
+                                                cellField);
+    classified = vtkm::cont::DataSet();
+    ArrayPool::Global().Release(numAffectedEdges);
+    std::cout << "Overlapped stages busy for upload : " << stages.Upload
+              << ", clip : " << stages.Clip << ", download : "
+              << stages.Download << ", wall : " << stages.Wall << std::endl;
+    times.Clip = stages.Wall;
+    return times;
+  }
+
+  ApplyThresholdToDataSet(classified, variable, countVar, dataIn, cellField);
+
+  classified = vtkm::cont::DataSet();
+  ArrayPool::Global().Release(numAffectedEdges);
+  times.Threshold = thresholdTimer.GetElapsedTime();
+
+  const int outSize = static_cast<int>(dataIn.size());
+  dataOut.clear();
+  dataOut.resize(outSize);
+  int pointer = 0;
+  //begin timing
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> clipTimer;
+  while(pointer < outSize - 1)
+  {
+    if(pointer + phases > outSize - 1)
+      phases = outSize - 1 - pointer;
+    LaunchClippingThreads(dataIn, variable, isoValue, dataOut, pointer, phases,
+                          cellField);
+    pointer += phases;
+  }
+  dataOut[outSize - 1] = dataIn[outSize - 1];
+  times.Clip = clipTimer.GetElapsedTime();
+  return times;
+}
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef CLIP_PLANNER_H
+#define CLIP_PLANNER_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vtkm/cont/CellSetExplicit.h>
+#include <vtkm/cont/CellSetSingleType.h>
+#include <vtkm/cont/CellSetStructured.h>
+
+#include "CaseExtraction.h"
+
+// Chooses between one ClipWithField over the whole dataset ("vanilla") and the
+// bucketed pipeline of ExtractCasesAndClip. The case distribution is
+// estimated from a random sample of cells classified on the host, and each
+// strategy is priced with a linear per-cell cost model. The default costs are
+// rough starting points; the drivers log predicted against actual times so
+// they can be calibrated with --cost-model.
+
+// Nanoseconds per cell of every step of the two strategies.
+struct ClipCostModel {
+  vtkm::Float64 Classify;     // case and edge count of a cell (bucketed)
+  vtkm::Float64 Threshold;    // one threshold pass, per input cell
+  vtkm::Float64 Copy;         // CellDeepCopy, per cell in a bucket
+  vtkm::Float64 ClipVisit;    // ClipWithField's own pass, per input cell
+  vtkm::Float64 ClipCut;      // extra for a cell the isosurface cuts
+  vtkm::Float64 ClipKeep;     // extra for a cell copied whole by the clip
+};
+
+inline ClipCostModel DefaultCostModel(const std::string &device) {
+  if (LowerCase(device) == "cuda")
+    return ClipCostModel{0.2, 0.3, 1.0, 0.5, 6.0, 1.5};
+  ClipCostModel model{5.0, 4.0, 20.0, 10.0, 300.0, 40.0};
+  if (LowerCase(device) == "tbb") {
+    vtkm::Float64 cores = std::max(1u, std::thread::hardware_concurrency());
+    for (vtkm::Float64 *cost : {&model.Classify, &model.Threshold, &model.Copy,
+                                &model.ClipVisit, &model.ClipCut, &model.ClipKeep})
+      *cost /= cores;
+  }
+  return model;
+}
+
+// Overrides the costs from "classify,threshold,copy,visit,cut,keep" in ns.
+inline ClipCostModel ParseCostModel(const std::string &costs,
+                                    ClipCostModel model) {
+  std::istringstream values(costs);
+  for (vtkm::Float64 *cost : {&model.Classify, &model.Threshold, &model.Copy,
+                              &model.ClipVisit, &model.ClipCut, &model.ClipKeep}) {
+    std::string value;
+    if (!std::getline(values, value, ','))
+      break;
+    *cost = atof(value.c_str());
+  }
+  return model;
+}
+
+// Cells of the sample in each bucket of ApplyThresholdToDataSet (7-12, 5-6,
+// 4 and 3 cut edges, then the cells entirely above), and below the isovalue.
+struct CaseSample {
+  vtkm::Id Sampled;
+  vtkm::Id Buckets[5];
+  vtkm::Id Below;
+};
+
+// Reads the field at the given points as Float64 on the host.
+struct ReadPointValues {
+  const std::vector<vtkm::Id> &m_pointIds;
+  std::vector<vtkm::Float64> &m_values;
+
+  ReadPointValues(const std::vector<vtkm::Id> &pointIds,
+                  std::vector<vtkm::Float64> &values)
+      : m_pointIds(pointIds), m_values(values) {}
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &field) const {
+    auto portal = field.GetPortalConstControl();
+    m_values.resize(m_pointIds.size());
+    for (size_t i = 0; i < m_pointIds.size(); i++)
+      m_values[i] = static_cast<vtkm::Float64>(portal.Get(m_pointIds[i]));
+  }
+};
+
+// Appends the points of cell in the corner order of GetCases. False for cell
+// sets the sampler does not know.
+inline bool AppendCellPoints(const vtkm::cont::DynamicCellSet &cellSet,
+                             const std::vector<vtkm::Id> &offsets,
+                             vtkm::Id cell, std::vector<vtkm::Id> &pointIds,
+                             std::vector<int> &counts) {
+  vtkm::TopologyElementTagPoint point;
+  vtkm::TopologyElementTagCell cellTag;
+  if (cellSet.IsSameType(vtkm::cont::CellSetStructured<3>())) {
+    vtkm::Id3 dims =
+        cellSet.Cast<vtkm::cont::CellSetStructured<3>>().GetPointDimensions();
+    vtkm::Id i = cell % (dims[0] - 1);
+    vtkm::Id j = (cell / (dims[0] - 1)) % (dims[1] - 1);
+    vtkm::Id k = cell / ((dims[0] - 1) * (dims[1] - 1));
+    vtkm::Id first = (k * dims[1] + j) * dims[0] + i;
+    vtkm::Id layer = dims[0] * dims[1];
+    for (vtkm::Id base : {first, first + layer})
+      for (vtkm::Id offset : {vtkm::Id(0), vtkm::Id(1), dims[0] + 1, dims[0]})
+        pointIds.push_back(base + offset);
+    counts.push_back(8);
+  } else if (cellSet.IsSameType(vtkm::cont::CellSetStructured<2>())) {
+    vtkm::Id2 dims =
+        cellSet.Cast<vtkm::cont::CellSetStructured<2>>().GetPointDimensions();
+    vtkm::Id first = (cell / (dims[0] - 1)) * dims[0] + cell % (dims[0] - 1);
+    for (vtkm::Id offset : {vtkm::Id(0), vtkm::Id(1), dims[0] + 1, dims[0]})
+      pointIds.push_back(first + offset);
+    counts.push_back(4);
+  } else if (cellSet.IsSameType(vtkm::cont::CellSetSingleType<>())) {
+    auto singleType = cellSet.Cast<vtkm::cont::CellSetSingleType<>>();
+    auto connectivity =
+        singleType.GetConnectivityArray(point, cellTag).GetPortalConstControl();
+    vtkm::Id perCell =
+        connectivity.GetNumberOfValues() / singleType.GetNumberOfCells();
+    for (vtkm::Id i = 0; i < perCell; i++)
+      pointIds.push_back(connectivity.Get(cell * perCell + i));
+    counts.push_back(static_cast<int>(perCell));
+  } else if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>())) {
+    auto explicitSet = cellSet.Cast<vtkm::cont::CellSetExplicit<>>();
+    auto connectivity =
+        explicitSet.GetConnectivityArray(point, cellTag).GetPortalConstControl();
+    vtkm::Id count = offsets[cell + 1] - offsets[cell];
+    for (vtkm::Id i = 0; i < count; i++)
+      pointIds.push_back(connectivity.Get(offsets[cell] + i));
+    counts.push_back(static_cast<int>(count));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Classifies samples random cells (with replacement, fixed seed) on the host.
+// Sampled is 0 when the cell set cannot be sampled.
+inline CaseSample SampleCases(vtkm::cont::DataSet &dataset,
+                              const std::string &variable,
+                              vtkm::Float32 isoValue, vtkm::Id samples) {
+  CaseSample sample = {0, {0, 0, 0, 0, 0}, 0};
+  vtkm::cont::DynamicCellSet cellSet = dataset.GetCellSet(0);
+  vtkm::Id numCells = cellSet.GetNumberOfCells();
+  if (numCells == 0 || samples <= 0)
+    return sample;
+
+  // Explicit cells are located through the running sum of their sizes.
+  std::vector<vtkm::Id> offsets;
+  if (cellSet.IsSameType(vtkm::cont::CellSetExplicit<>())) {
+    auto numIndices = cellSet.Cast<vtkm::cont::CellSetExplicit<>>()
+                          .GetNumIndicesArray(vtkm::TopologyElementTagPoint(),
+                                              vtkm::TopologyElementTagCell())
+                          .GetPortalConstControl();
+    offsets.resize(static_cast<size_t>(numCells + 1), 0);
+    for (vtkm::Id i = 0; i < numCells; i++)
+      offsets[i + 1] = offsets[i] + numIndices.Get(i);
+  }
+
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<vtkm::Id> pick(0, numCells - 1);
+  std::vector<vtkm::Id> pointIds;
+  std::vector<int> counts;
+  for (vtkm::Id i = 0; i < std::min(samples, numCells); i++)
+    if (!AppendCellPoints(cellSet, offsets, pick(generator), pointIds, counts))
+      return sample;
+
+  std::vector<vtkm::Float64> values;
+  GetScalarField(dataset, variable).CastAndCall(ReadPointValues(pointIds, values));
+  std::vector<vtkm::Id> caseToEdge;
+  CalculateAffectedEdges(caseToEdge);
+
+  size_t next = 0;
+  for (int count : counts) {
+    vtkm::Id caseId = 0;
+    for (int i = 0; i < count; i++, next++)
+      caseId |= (values[next] > isoValue) ? (vtkm::Id(1) << i) : 0;
+    vtkm::Id edges = caseToEdge[static_cast<size_t>(caseId & 255)];
+    if (edges >= 7)
+      sample.Buckets[0]++;
+    else if (edges >= 5)
+      sample.Buckets[1]++;
+    else if (edges == 4)
+      sample.Buckets[2]++;
+    else if (edges == 3)
+      sample.Buckets[3]++;
+    else if (edges == -1)
+      sample.Buckets[4]++;
+    else
+      sample.Below++;
+    sample.Sampled++;
+  }
+  return sample;
+}
+
+struct ClipPlan {
+  std::string Strategy;
+  vtkm::Float64 VanillaTime;
+  vtkm::Float64 BucketedTime;
+  CaseSample Sample;
+
+  vtkm::Float64 PredictedTime() const {
+    return this->Strategy == "vanilla" ? this->VanillaTime : this->BucketedTime;
+  }
+};
+
+// Prices both strategies for numCells cells with the sampled distribution.
+// The buckets are clipped phases at a time; on the serial device those clips
+// run on separate threads, on the others they share the device.
+inline ClipPlan PlanClip(vtkm::cont::DataSet &dataset,
+                         const std::string &variable, vtkm::Float32 isoValue,
+                         int phases, const std::string &device,
+                         const ClipCostModel &model, vtkm::Id samples) {
+  ClipPlan plan;
+  plan.Sample = SampleCases(dataset, variable, isoValue, samples);
+  plan.Strategy = "bucketed";
+  plan.VanillaTime = plan.BucketedTime = 0;
+  const CaseSample &sample = plan.Sample;
+  if (sample.Sampled == 0)
+    return plan;
+
+  vtkm::Float64 numCells =
+      static_cast<vtkm::Float64>(dataset.GetCellSet(0).GetNumberOfCells());
+  vtkm::Float64 scale = numCells / static_cast<vtkm::Float64>(sample.Sampled);
+  vtkm::Float64 cut = 0;
+  for (int i = 0; i < 4; i++)
+    cut += static_cast<vtkm::Float64>(sample.Buckets[i]) * scale;
+  vtkm::Float64 above = static_cast<vtkm::Float64>(sample.Buckets[4]) * scale;
+
+  plan.VanillaTime = 1e-9 * (numCells * model.ClipVisit + cut * model.ClipCut +
+                             above * model.ClipKeep);
+
+  vtkm::Float64 concurrency =
+      (LowerCase(device) == "serial")
+          ? std::min<vtkm::Float64>(std::max(1, phases),
+                                    std::max(1u, std::thread::hardware_concurrency()))
+          : 1.0;
+  plan.BucketedTime =
+      1e-9 * (numCells * (model.Classify + 5 * model.Threshold) +
+              (cut + above) * model.Copy +
+              cut * (model.ClipVisit + model.ClipCut) / concurrency);
+
+  plan.Strategy = (plan.VanillaTime < plan.BucketedTime) ? "vanilla" : "bucketed";
+  return plan;
+}
+
+inline void PrintPlan(const ClipPlan &plan, std::ostream &out) {
+  const CaseSample &sample = plan.Sample;
+  if (sample.Sampled == 0) {
+    out << "Planner could not sample this cell set, using bucketed" << std::endl;
+    return;
+  }
+  out << "Planner sampled " << sample.Sampled << " cells : ";
+  const char *names[] = {"7-12", "5-6", "4", "3", "whole"};
+  for (int i = 0; i < 5; i++)
+    out << names[i] << " edges " << sample.Buckets[i] << ", ";
+  out << "below " << sample.Below << std::endl;
+  out << "Planner predicted vanilla : " << plan.VanillaTime
+      << ", bucketed : " << plan.BucketedTime << ", choosing " << plan.Strategy
+      << std::endl;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SIMD_CLASSIFICATION_H
+#define SIMD_CLASSIFICATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <vtkm/Types.h>
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/ArrayPortalToIterators.h>
+#include <vtkm/cont/CellSetStructured.h>
+#include <vtkm/cont/DynamicCellSet.h>
+
+#if (defined(__AVX512F__) || defined(__AVX2__)) && !defined(__CUDA_ARCH__)
+#include <immintrin.h>
+#endif
+
+// Host classification of structured grids in two passes. The points are
+// first compared against the isovalue a SIMD register at a time, giving one
+// above/below bit per point; the case of every cell is then assembled from
+// the bits of its corners, which are neighbours along rows. Compiled for the
+// widest instruction set the build enables (-march=native or -mavx2), with a
+// scalar loop otherwise.
+
+inline std::string SimdInstructionSet() {
+#if defined(__AVX512F__) && !defined(__CUDA_ARCH__)
+  return "avx512";
+#elif defined(__AVX2__) && !defined(__CUDA_ARCH__)
+  return "avx2";
+#else
+  return "scalar";
+#endif
+}
+
+// Runs body(begin, end) over [0, count) in chunks on workers threads.
+template <typename Body>
+void ForEachChunk(vtkm::Id count, int workers, vtkm::Id chunkSize, Body body) {
+  if (workers <= 1 || count <= chunkSize) {
+    body(0, count);
+    return;
+  }
+  std::atomic<vtkm::Id> nextChunk(0);
+  auto worker = [&]() {
+    for (vtkm::Id begin = chunkSize * nextChunk++; begin < count;
+         begin = chunkSize * nextChunk++)
+      body(begin, std::min(count, begin + chunkSize));
+  };
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < workers; i++)
+    futures.push_back(std::async(std::launch::async, worker));
+  for (auto &future : futures)
+    future.get();
+}
+
+// Bit i of the result is set when values[i] > isoValue, as in GetCases, so
+// NaN counts as below. A trailing zero word lets the cell pass read 64 bits
+// from any point.
+inline std::vector<vtkm::UInt64> ClassifyPoints(const vtkm::Float32 *values,
+                                                vtkm::Id numPoints,
+                                                vtkm::Float32 isoValue,
+                                                int workers) {
+  vtkm::Id numWords = (numPoints + 63) / 64;
+  std::vector<vtkm::UInt64> bits(static_cast<size_t>(numWords + 1), 0);
+  ForEachChunk(numWords, workers, 4096, [&](vtkm::Id begin, vtkm::Id end) {
+    for (vtkm::Id word = begin; word < end; word++) {
+      const vtkm::Float32 *block = values + 64 * word;
+      vtkm::UInt64 mask = 0;
+      if (64 * word + 64 <= numPoints) {
+#if defined(__AVX512F__) && !defined(__CUDA_ARCH__)
+        __m512 iso = _mm512_set1_ps(isoValue);
+        for (int lane = 0; lane < 4; lane++)
+          mask |= static_cast<vtkm::UInt64>(_mm512_cmp_ps_mask(
+                      _mm512_loadu_ps(block + 16 * lane), iso, _CMP_GT_OQ))
+                  << (16 * lane);
+#elif defined(__AVX2__) && !defined(__CUDA_ARCH__)
+        __m256 iso = _mm256_set1_ps(isoValue);
+        for (int lane = 0; lane < 8; lane++)
+          mask |= static_cast<vtkm::UInt64>(static_cast<unsigned>(
+                      _mm256_movemask_ps(_mm256_cmp_ps(
+                          _mm256_loadu_ps(block + 8 * lane), iso, _CMP_GT_OQ))))
+                  << (8 * lane);
+#else
+        for (int i = 0; i < 64; i++)
+          mask |= static_cast<vtkm::UInt64>(block[i] > isoValue) << i;
+#endif
+      } else {
+        for (vtkm::Id i = 0; i < numPoints - 64 * word; i++)
+          mask |= static_cast<vtkm::UInt64>(block[i] > isoValue) << i;
+      }
+      bits[static_cast<size_t>(word)] = mask;
+    }
+  });
+  return bits;
+}
+
+// The 64 point bits starting at point start.
+inline vtkm::UInt64 BitWindow(const std::vector<vtkm::UInt64> &bits,
+                              vtkm::Id start) {
+  size_t word = static_cast<size_t>(start >> 6);
+  int shift = static_cast<int>(start & 63);
+  vtkm::UInt64 low = bits[word] >> shift;
+  return shift == 0 ? low : low | (bits[word + 1] << (64 - shift));
+}
+
+// Cases of the cells of a structured grid with pointDims points (a z extent
+// of 1 for 2D grids), with the corner order of the VTK-m hexahedron and quad:
+// the first four corners go around the lower face starting at (i, j, k), the
+// other four around the upper face.
+inline void AssembleCellCases(const std::vector<vtkm::UInt64> &bits,
+                              vtkm::Id3 pointDims, vtkm::Id *cases,
+                              int workers) {
+  bool is3d = pointDims[2] > 1;
+  vtkm::Id nx = pointDims[0], ny = pointDims[1];
+  vtkm::Id cellsX = nx - 1, cellsY = ny - 1;
+  vtkm::Id cellsZ = is3d ? pointDims[2] - 1 : 1;
+  ForEachChunk(cellsY * cellsZ, workers, 64, [&](vtkm::Id begin, vtkm::Id end) {
+    for (vtkm::Id row = begin; row < end; row++) {
+      vtkm::Id j = row % cellsY, k = row / cellsY;
+      vtkm::Id lower = (k * ny + j) * nx;
+      vtkm::Id upper = lower + nx * ny;
+      vtkm::Id *out = cases + row * cellsX;
+      // A window of 64 point bits covers 63 cells.
+      for (vtkm::Id i = 0; i < cellsX; i += 63) {
+        vtkm::UInt64 front = BitWindow(bits, lower + i);
+        vtkm::UInt64 back = BitWindow(bits, lower + nx + i);
+        vtkm::UInt64 upFront = is3d ? BitWindow(bits, upper + i) : 0;
+        vtkm::UInt64 upBack = is3d ? BitWindow(bits, upper + nx + i) : 0;
+        vtkm::Id count = std::min<vtkm::Id>(63, cellsX - i);
+        for (vtkm::Id n = 0; n < count; n++) {
+          out[i + n] = static_cast<vtkm::Id>(
+              (front & 1) | ((front >> 1 & 1) << 1) | ((back >> 1 & 1) << 2) |
+              ((back & 1) << 3) | ((upFront & 1) << 4) |
+              ((upFront >> 1 & 1) << 5) | ((upBack >> 1 & 1) << 6) |
+              ((upBack & 1) << 7));
+          front >>= 1;
+          back >>= 1;
+          upFront >>= 1;
+          upBack >>= 1;
+        }
+      }
+    }
+  });
+}
+
+// Cases of every cell of a structured cell set over a stored Float32 point
+// field, into cases (already sized to the number of cells). False, leaving
+// cases untouched, for any other cell set or field, which take the worklets.
+template <typename T, typename Storage>
+bool ClassifyStructuredCells(const vtkm::cont::DynamicCellSet &,
+                             const vtkm::cont::ArrayHandle<T, Storage> &,
+                             vtkm::Float32, vtkm::cont::ArrayHandle<vtkm::Id> &,
+                             int) {
+  return false;
+}
+
+inline bool ClassifyStructuredCells(const vtkm::cont::DynamicCellSet &cellSet,
+                                    const vtkm::cont::ArrayHandle<vtkm::Float32> &field,
+                                    vtkm::Float32 isoValue,
+                                    vtkm::cont::ArrayHandle<vtkm::Id> &cases,
+                                    int workers) {
+  vtkm::Id3 pointDims(1, 1, 1);
+  if (cellSet.IsSameType(vtkm::cont::CellSetStructured<3>())) {
+    pointDims = cellSet.Cast<vtkm::cont::CellSetStructured<3>>().GetPointDimensions();
+  } else if (cellSet.IsSameType(vtkm::cont::CellSetStructured<2>())) {
+    vtkm::Id2 dims = cellSet.Cast<vtkm::cont::CellSetStructured<2>>().GetPointDimensions();
+    pointDims = vtkm::Id3(dims[0], dims[1], 1);
+  } else {
+    return false;
+  }
+  vtkm::Id numPoints = pointDims[0] * pointDims[1] * pointDims[2];
+  if (field.GetNumberOfValues() != numPoints || cases.GetNumberOfValues() == 0)
+    return false;
+
+  auto fieldPortal = field.GetPortalConstControl();
+  auto casePortal = cases.GetPortalControl();
+  std::vector<vtkm::UInt64> bits = ClassifyPoints(
+      &(*vtkm::cont::ArrayPortalToIteratorBegin(fieldPortal)), numPoints,
+      isoValue, workers);
+  AssembleCellCases(bits, pointDims,
+                    &(*vtkm::cont::ArrayPortalToIteratorBegin(casePortal)),
+                    workers);
+  return true;
+}
+
+#endif
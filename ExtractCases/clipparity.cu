@@ -0,0 +1,2 @@
+#define VTKM_DEVICE_ADAPTER VTKM_DEVICE_ADAPTER_CUDA
+#include "clipparity.cxx"
@@ -0,0 +1,479 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef VTKM_DEVICE_ADAPTER
+#define VTKM_DEVICE_ADAPTER VTKM_DEVICE_ADAPTER_SERIAL
+#endif
+
+#include <vtkm/cont/ArrayHandleIndex.h>
+#include <vtkm/cont/ErrorBadValue.h>
+
+#include "CaseExtraction.h"
+#include "CellVolume.h"
+#include "MinMaxIsoVolume.h"
+
+// Parity suite for the clip paths. Every dataset is clipped by the reference,
+// one ClipWithField over the whole dataset as vanilla does, and by each
+// optimized path: the bucketed pipeline with every classifier and with the
+// overlapped stages, and performMinMaxIsoVolume's double negation against two
+// plain clips. The outputs are compared on their cell count, total volume,
+// field range and how many output cells every original cell was split into,
+// and the time of every path is recorded next to the checks, so that a
+// regression in either shows up in the same report.
+
+// What is compared between two clips of the same dataset.
+struct ClipMetrics {
+  vtkm::Id Cells = 0;
+  vtkm::Float64 Volume = 0;
+  vtkm::Float64 FieldMin = std::numeric_limits<vtkm::Float64>::infinity();
+  vtkm::Float64 FieldMax = -std::numeric_limits<vtkm::Float64>::infinity();
+  // Output cells per original cell id.
+  std::map<vtkm::Id, vtkm::Id> Splits;
+  vtkm::Float64 Seconds = 0;
+};
+
+// Adds the cells of one clip output (or one bucket of it) to metrics. The
+// field range only covers the points the cells use, as thresholded buckets
+// keep every point of their input.
+inline void AccumulateMetrics(const vtkm::cont::DataSet &output,
+                              const std::string &variable,
+                              const std::string &cellField,
+                              ClipMetrics &metrics) {
+  vtkm::cont::DynamicCellSet cellSet = output.GetCellSet(0);
+  if (cellSet.GetNumberOfCells() == 0)
+    return;
+  if (!cellSet.IsSameType(vtkm::cont::CellSetExplicit<>()))
+    throw vtkm::cont::ErrorBadValue("Clip output is not an explicit cell set");
+  auto explicitSet = cellSet.Cast<vtkm::cont::CellSetExplicit<>>();
+  vtkm::TopologyElementTagPoint point;
+  vtkm::TopologyElementTagCell cell;
+  auto shapes = explicitSet.GetShapesArray(point, cell).GetPortalConstControl();
+  auto numIndices =
+      explicitSet.GetNumIndicesArray(point, cell).GetPortalConstControl();
+  auto connectivity =
+      explicitSet.GetConnectivityArray(point, cell).GetPortalConstControl();
+
+  std::vector<HostPoint> coordinates;
+  output.GetCoordinateSystem().GetData().CastAndCall(
+      CopyArrayToHost<HostPoint>(coordinates));
+  std::vector<vtkm::Float64> field;
+  GetScalarField(output, variable).CastAndCall(
+      CopyArrayToHost<vtkm::Float64>(field));
+  std::vector<vtkm::Id> cellIds;
+  output.GetCellField(cellField)
+      .GetData()
+      .ResetTypeAndStorageLists(ScalarFieldTypeList(), ImplicitFieldStorageList())
+      .CastAndCall(CopyArrayToHost<vtkm::Id>(cellIds));
+
+  vtkm::Id numCells = cellSet.GetNumberOfCells();
+  std::vector<HostPoint> cellPoints;
+  vtkm::Id offset = 0;
+  for (vtkm::Id c = 0; c < numCells; c++) {
+    vtkm::IdComponent count = numIndices.Get(c);
+    cellPoints.resize(static_cast<size_t>(count));
+    for (vtkm::IdComponent i = 0; i < count; i++) {
+      size_t pointId = static_cast<size_t>(connectivity.Get(offset + i));
+      cellPoints[static_cast<size_t>(i)] = coordinates[pointId];
+      metrics.FieldMin = std::min(metrics.FieldMin, field[pointId]);
+      metrics.FieldMax = std::max(metrics.FieldMax, field[pointId]);
+    }
+    offset += count;
+    metrics.Volume += CellVolume(shapes.Get(c), cellPoints);
+    metrics.Splits[cellIds[static_cast<size_t>(c)]]++;
+  }
+  metrics.Cells += numCells;
+}
+
+inline ClipMetrics MeasureOutputs(const std::vector<vtkm::cont::DataSet> &outputs,
+                                  const std::string &variable,
+                                  const std::string &cellField,
+                                  vtkm::Float64 seconds) {
+  ClipMetrics metrics;
+  for (const vtkm::cont::DataSet &output : outputs)
+    AccumulateMetrics(output, variable, cellField, metrics);
+  metrics.Seconds = seconds;
+  return metrics;
+}
+
+struct ParityRow {
+  std::string DataSet;
+  std::string IsoValue;
+  std::string Path;
+  std::string Metric;
+  vtkm::Float64 Reference;
+  vtkm::Float64 Value;
+  bool Pass;
+};
+
+// Relative to the larger magnitude, with floor standing in for values near 0.
+inline bool WithinTolerance(vtkm::Float64 reference, vtkm::Float64 value,
+                            vtkm::Float64 tolerance, vtkm::Float64 floor) {
+  vtkm::Float64 scale =
+      std::max(floor, std::max(std::fabs(reference), std::fabs(value)));
+  return std::fabs(value - reference) <= tolerance * scale;
+}
+
+struct ParityReport {
+  std::vector<ParityRow> Rows;
+  vtkm::Float64 Tolerance = 1e-5;
+  // Seconds per dataset, isovalue and path of an earlier run, and how much
+  // slower (as a fraction) a path may get before it counts as a regression.
+  std::map<std::string, vtkm::Float64> Baseline;
+  vtkm::Float64 SpeedTolerance = 0.5;
+
+  void Add(const std::string &dataset, const std::string &iso,
+           const std::string &path, const std::string &metric,
+           vtkm::Float64 reference, vtkm::Float64 value, bool pass) {
+    this->Rows.push_back({dataset, iso, path, metric, reference, value, pass});
+  }
+
+  // Records the time of path against the reference path, and against the
+  // baseline when it has this path.
+  void AddTiming(const std::string &dataset, const std::string &iso,
+                 const std::string &path, vtkm::Float64 referenceSeconds,
+                 vtkm::Float64 seconds) {
+    this->Add(dataset, iso, path, "seconds", referenceSeconds, seconds, true);
+    auto baseline = this->Baseline.find(dataset + "," + iso + "," + path);
+    if (baseline != this->Baseline.end())
+      this->Add(dataset, iso, path, "seconds vs baseline", baseline->second,
+                seconds,
+                seconds <= baseline->second * (1 + this->SpeedTolerance));
+  }
+
+  // Checks the clip of path against the reference clip.
+  void Compare(const std::string &dataset, const std::string &iso,
+               const std::string &path, const ClipMetrics &reference,
+               const ClipMetrics &value) {
+    this->Add(dataset, iso, path, "cells", reference.Cells, value.Cells,
+              reference.Cells == value.Cells);
+    this->Add(dataset, iso, path, "volume", reference.Volume, value.Volume,
+              WithinTolerance(reference.Volume, value.Volume, this->Tolerance,
+                              1e-12));
+    if (reference.Cells > 0 && value.Cells > 0) {
+      this->Add(dataset, iso, path, "field min", reference.FieldMin,
+                value.FieldMin,
+                WithinTolerance(reference.FieldMin, value.FieldMin,
+                                this->Tolerance, 1));
+      this->Add(dataset, iso, path, "field max", reference.FieldMax,
+                value.FieldMax,
+                WithinTolerance(reference.FieldMax, value.FieldMax,
+                                this->Tolerance, 1));
+    }
+
+    // Original cells split into a different number of output cells, or kept
+    // by only one of the two clips.
+    vtkm::Id referenceSplit = 0, valueSplit = 0, mismatches = 0;
+    auto r = reference.Splits.begin();
+    auto v = value.Splits.begin();
+    while (r != reference.Splits.end() || v != value.Splits.end()) {
+      if (v == value.Splits.end() ||
+          (r != reference.Splits.end() && r->first < v->first)) {
+        referenceSplit += (r->second > 1) ? 1 : 0;
+        mismatches++;
+        ++r;
+      } else if (r == reference.Splits.end() || v->first < r->first) {
+        valueSplit += (v->second > 1) ? 1 : 0;
+        mismatches++;
+        ++v;
+      } else {
+        referenceSplit += (r->second > 1) ? 1 : 0;
+        valueSplit += (v->second > 1) ? 1 : 0;
+        mismatches += (r->second != v->second) ? 1 : 0;
+        ++r;
+        ++v;
+      }
+    }
+    this->Add(dataset, iso, path, "split cells", referenceSplit, valueSplit,
+              referenceSplit == valueSplit);
+    this->Add(dataset, iso, path, "split mismatches", 0, mismatches,
+              mismatches == 0);
+    this->AddTiming(dataset, iso, path, reference.Seconds, value.Seconds);
+  }
+
+  size_t Failures() const {
+    size_t failures = 0;
+    for (const ParityRow &row : this->Rows)
+      failures += row.Pass ? 0 : 1;
+    return failures;
+  }
+
+  void WriteCsv(std::ostream &out) const {
+    out << "dataset,iso,path,metric,reference,value,diff,pass" << std::endl;
+    out << std::setprecision(12);
+    for (const ParityRow &row : this->Rows)
+      out << row.DataSet << "," << row.IsoValue << "," << row.Path << ","
+          << row.Metric << "," << row.Reference << "," << row.Value << ","
+          << row.Value - row.Reference << "," << (row.Pass ? 1 : 0)
+          << std::endl;
+  }
+};
+
+// Reads the seconds of every path from a CSV written by --csv.
+inline std::map<std::string, vtkm::Float64> ReadBaseline(const std::string &path) {
+  std::map<std::string, vtkm::Float64> baseline;
+  std::ifstream file(path);
+  if (!file) {
+    std::cerr << "Cannot read baseline " << path << std::endl;
+    return baseline;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    std::vector<std::string> columns;
+    std::istringstream items(line);
+    std::string item;
+    while (std::getline(items, item, ','))
+      columns.push_back(item);
+    if (columns.size() >= 6 && columns[3] == "seconds")
+      baseline[columns[0] + "," + columns[1] + "," + columns[2]] =
+          atof(columns[5].c_str());
+  }
+  return baseline;
+}
+
+inline std::vector<std::string> SplitList(const std::string &list) {
+  std::vector<std::string> items;
+  std::istringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+// Files may not carry the original cell ids; synthetic datasets already have
+// them as an implicit array.
+inline void AddImplicitCellIds(vtkm::cont::DataSet &dataset,
+                               const std::string &cellField) {
+  for (vtkm::Id i = 0; i < dataset.GetNumberOfFields(); i++)
+    if (dataset.GetField(i).GetName() == cellField)
+      return;
+  vtkm::cont::DynamicCellSet cellSet = dataset.GetCellSet(0);
+  dataset.AddField(vtkm::cont::Field(
+      cellField, vtkm::cont::Field::ASSOC_CELL_SET, cellSet.GetName(),
+      vtkm::cont::ArrayHandleIndex(cellSet.GetNumberOfCells())));
+}
+
+// The min-max isovolume as two plain clips: at isoValMin, then at 0 on the
+// derived field isoValMax - variable, computed on the host so that nothing is
+// shared with the double negation but ClipWithField itself.
+inline void ReferenceMinMaxIsoVolume(vtkm::cont::DataSet &input,
+                                     const std::string &variable,
+                                     const std::string &cellField,
+                                     vtkm::Float32 isoValMin,
+                                     vtkm::Float32 isoValMax,
+                                     vtkm::cont::DataSet &output) {
+  vtkm::cont::DataSet aboveMin;
+  performTrivialIsoVolume(input, variable, isoValMin, aboveMin, cellField);
+
+  std::vector<vtkm::Float64> values;
+  GetScalarField(aboveMin, variable).CastAndCall(
+      CopyArrayToHost<vtkm::Float64>(values));
+  vtkm::cont::ArrayHandle<vtkm::Float32> belowMax;
+  belowMax.Allocate(static_cast<vtkm::Id>(values.size()));
+  auto portal = belowMax.GetPortalControl();
+  for (size_t i = 0; i < values.size(); i++)
+    portal.Set(static_cast<vtkm::Id>(i),
+               static_cast<vtkm::Float32>(isoValMax - values[i]));
+  const std::string belowMaxVar("belowMax");
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  datasetFieldAdder.AddPointField(aboveMin, belowMaxVar, belowMax);
+
+  vtkm::filter::ClipWithField clip;
+  clip.SetClipValue(0);
+  ImplicitFieldPolicy policy;
+  vtkm::filter::Result result = clip.Execute(aboveMin, belowMaxVar, policy);
+  clip.MapFieldOntoOutput(result, aboveMin.GetPointField(variable), policy);
+  clip.MapFieldOntoOutput(result, aboveMin.GetCellField(cellField), policy);
+  output = result.GetDataSet();
+}
+
+// Times of the runs of one path: the first run, with the allocator and the
+// page cache still cold, and the fastest of all runs.
+struct RunTimes {
+  vtkm::Float64 First;
+  vtkm::Float64 Best;
+};
+
+// Runs clip repeat times; the outputs of the last run are kept.
+template <typename ClipFunctor>
+RunTimes TimeRuns(int repeat, ClipFunctor clip) {
+  RunTimes times;
+  times.First = times.Best = std::numeric_limits<vtkm::Float64>::infinity();
+  for (int run = 0; run < repeat; run++) {
+    vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> timer;
+    clip();
+    vtkm::Float64 seconds = timer.GetElapsedTime();
+    if (run == 0)
+      times.First = seconds;
+    times.Best = std::min(times.Best, seconds);
+  }
+  return times;
+}
+
+int main(int argc, char **argv) {
+  std::map<std::string, std::string> options;
+  for (int index = 1; index < argc; index++) {
+    std::string arg(argv[index]);
+    if (arg.compare(0, 2, "--") != 0)
+      continue;
+    size_t split = arg.find('=');
+    options[arg.substr(2, split - 2)] =
+        (split == std::string::npos) ? "" : arg.substr(split + 1);
+  }
+  if (options.count("help")) {
+    std::cout << "Usage : " << argv[0]
+              << " [--datasets=spec,...] [--variable=name] [--isovalues=v,...]"
+              << " [--minmax=min,max] [--phases=N] [--repeat=N]"
+              << " [--tolerance=relative] [--csv=file] [--baseline=file]"
+              << " [--speed-tolerance=fraction] [--device=serial|tbb|cuda]"
+              << std::endl;
+    exit(1);
+  }
+  std::string device = SelectDevice(options["device"]);
+  std::cout << "Running on device : " << device << std::endl;
+
+  // Files or synthetic:<field>:<dims> specs, by default one of each field.
+  std::vector<std::string> datasets = SplitList(
+      options.count("datasets")
+          ? options["datasets"]
+          : "synthetic:shells:48,synthetic:gradient:48,synthetic:noise:48");
+  const std::string variable =
+      options.count("variable") ? options["variable"] : "scalar";
+  std::vector<std::string> isoValues = SplitList(
+      options.count("isovalues") ? options["isovalues"] : "0.3,0.5");
+  std::vector<std::string> range =
+      SplitList(options.count("minmax") ? options["minmax"] : "0.25,0.75");
+  if (range.size() != 2) {
+    std::cout << "Expected --minmax=min,max" << std::endl;
+    exit(1);
+  }
+  int phases = options.count("phases") ? atoi(options["phases"].c_str()) : 2;
+  int repeat =
+      std::max(1, options.count("repeat") ? atoi(options["repeat"].c_str()) : 3);
+  const std::string cellIdsVar("cellIds");
+
+  ParityReport report;
+  if (options.count("tolerance"))
+    report.Tolerance = atof(options["tolerance"].c_str());
+  if (options.count("speed-tolerance"))
+    report.SpeedTolerance = atof(options["speed-tolerance"].c_str());
+  if (options.count("baseline"))
+    report.Baseline = ReadBaseline(options["baseline"]);
+
+  const std::vector<std::string> classifiers = {"worklet", "packed", "simd"};
+  for (const std::string &spec : datasets) {
+    vtkm::cont::DataSet dataset = LoadDataSet(spec, variable);
+    AddImplicitCellIds(dataset, cellIdsVar);
+    std::cout << "Checking " << spec << " ("
+              << dataset.GetCellSet(0).GetNumberOfCells() << " cells)"
+              << std::endl;
+
+    for (const std::string &iso : isoValues) {
+      vtkm::Float32 isoValue = static_cast<vtkm::Float32>(atof(iso.c_str()));
+      std::vector<vtkm::cont::DataSet> vanilla(1);
+      RunTimes vanillaTimes = TimeRuns(repeat, [&]() {
+        performTrivialIsoVolume(dataset, variable, isoValue, vanilla[0],
+                                cellIdsVar);
+      });
+      ClipMetrics reference =
+          MeasureOutputs(vanilla, variable, cellIdsVar, vanillaTimes.Best);
+      report.AddTiming(spec, iso, "vanilla", vanillaTimes.Best,
+                       vanillaTimes.Best);
+      report.Add(spec, iso, "vanilla", "first run seconds", vanillaTimes.First,
+                 vanillaTimes.First, true);
+
+      for (size_t path = 0; path <= classifiers.size(); path++) {
+        // The last path overlaps the stages with the default classifier.
+        bool overlap = (path == classifiers.size());
+        std::string classifier = overlap ? "packed" : classifiers[path];
+        std::string name = overlap ? "bucketed-overlap" : "bucketed-" + classifier;
+        std::vector<vtkm::cont::DataSet> dataIn, dataOut;
+        RunTimes times = TimeRuns(repeat, [&]() {
+          dataIn.clear();
+          ExtractCasesAndClip(dataset, variable, isoValue, phases, dataIn,
+                              dataOut, classifier, overlap, cellIdsVar);
+        });
+        report.Compare(spec, iso, name, reference,
+                       MeasureOutputs(dataOut, variable, cellIdsVar, times.Best));
+        report.Add(spec, iso, name, "first run seconds", vanillaTimes.First,
+                   times.First, true);
+      }
+    }
+
+    // The double negation of performMinMaxIsoVolume against two plain clips;
+    // the restored field must also stay within the isovalues.
+    std::string iso = range[0] + ":" + range[1];
+    vtkm::Float32 isoValMin = static_cast<vtkm::Float32>(atof(range[0].c_str()));
+    vtkm::Float32 isoValMax = static_cast<vtkm::Float32>(atof(range[1].c_str()));
+    std::vector<vtkm::cont::DataSet> twoClips(1), minMax(1);
+    RunTimes twoClipsTimes = TimeRuns(repeat, [&]() {
+      ReferenceMinMaxIsoVolume(dataset, variable, cellIdsVar, isoValMin,
+                               isoValMax, twoClips[0]);
+    });
+    ClipMetrics reference =
+        MeasureOutputs(twoClips, variable, cellIdsVar, twoClipsTimes.Best);
+    report.AddTiming(spec, iso, "two-clips", twoClipsTimes.Best,
+                     twoClipsTimes.Best);
+    report.Add(spec, iso, "two-clips", "first run seconds", twoClipsTimes.First,
+               twoClipsTimes.First, true);
+    RunTimes minMaxTimes = TimeRuns(repeat, [&]() {
+      vtkm::filter::Result result;
+      MinMaxIsoVolume(dataset, variable, cellIdsVar, isoValMin, isoValMax,
+                      result);
+      minMax[0] = result.GetDataSet();
+    });
+    ClipMetrics restored =
+        MeasureOutputs(minMax, variable, cellIdsVar, minMaxTimes.Best);
+    report.Compare(spec, iso, "minmax", reference, restored);
+    report.Add(spec, iso, "minmax", "first run seconds", twoClipsTimes.First,
+               minMaxTimes.First, true);
+    if (restored.Cells > 0) {
+      vtkm::Float64 slack = report.Tolerance * std::max(1.0, std::fabs(isoValMax));
+      report.Add(spec, iso, "minmax", "restored min", isoValMin,
+                 restored.FieldMin, restored.FieldMin >= isoValMin - slack);
+      report.Add(spec, iso, "minmax", "restored max", isoValMax,
+                 restored.FieldMax, restored.FieldMax <= isoValMax + slack);
+    }
+  }
+
+  // One line per path: its best and first run times, and the checks that
+  // failed.
+  std::map<std::string, std::vector<const ParityRow *>> byPath;
+  for (const ParityRow &row : report.Rows)
+    byPath[row.DataSet + " " + row.IsoValue + " " + row.Path].push_back(&row);
+  for (auto &path : byPath) {
+    std::string failed;
+    vtkm::Float64 seconds = 0, referenceSeconds = 0, firstSeconds = 0;
+    for (const ParityRow *row : path.second) {
+      if (row->Metric == "seconds") {
+        seconds = row->Value;
+        referenceSeconds = row->Reference;
+      }
+      if (row->Metric == "first run seconds")
+        firstSeconds = row->Value;
+      if (!row->Pass)
+        failed += " " + row->Metric;
+    }
+    std::cout << path.first << " : " << seconds << " s ("
+              << referenceSeconds / std::max(seconds, 1e-12)
+              << "x reference, first run " << firstSeconds << " s) : "
+              << (failed.empty() ? "PASS" : "FAIL")
+              << failed << std::endl;
+  }
+  if (options.count("csv")) {
+    std::ofstream csv(options["csv"]);
+    report.WriteCsv(csv);
+  }
+  size_t failures = report.Failures();
+  std::cout << "Parity checks passed : " << report.Rows.size() - failures
+            << " of " << report.Rows.size() << std::endl;
+  return failures == 0 ? 0 : 1;
+}
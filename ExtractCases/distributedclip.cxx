@@ -0,0 +1,294 @@
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#ifndef VTKM_DEVICE_ADAPTER
+#define VTKM_DEVICE_ADAPTER VTKM_DEVICE_ADAPTER_SERIAL
+#endif
+
+#include <vtkm/cont/ArrayHandleConstant.h>
+#include <vtkm/cont/ArrayHandleIndex.h>
+#include <vtkm/cont/ArrayHandleUniformPointCoordinates.h>
+#include <vtkm/cont/CellSetStructured.h>
+#include <vtkm/cont/DeviceAdapterAlgorithm.h>
+
+#include "CaseExtraction.h"
+
+// Distributed isovolume. Every rank clips one slab of a structured domain and
+// the cell counts, split statistics and timings are reduced on rank 0. Runs
+// as well under mpirun on a single box as across nodes, e.g.
+//
+//   mpirun -np 4 ./distributedclip synthetic:noise:512 myscalar 0.5
+//
+// File inputs are read whole by every rank, which then keeps its slab: the
+// legacy VTK reader cannot read part of a file, so every rank needs the
+// memory of the whole dataset for the load, and the file should sit on a
+// shared file system. Synthetic inputs are implicit, so each rank only
+// stores its own slab.
+
+// Copies the point values of a slab, a contiguous range of the flat point
+// array since x varies fastest, keeping the value type of the field.
+template <typename Device> struct GatherSlab {
+  vtkm::Id m_start;
+  vtkm::Id m_numValues;
+  vtkm::cont::DynamicArrayHandle &m_values;
+
+  GatherSlab(vtkm::Id start, vtkm::Id numValues,
+             vtkm::cont::DynamicArrayHandle &values)
+      : m_start(start), m_numValues(numValues), m_values(values) {}
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &field) const {
+    vtkm::cont::ArrayHandle<T> values;
+    vtkm::cont::DeviceAdapterAlgorithm<Device>::CopySubRange(
+        field, m_start, m_numValues, values);
+    m_values = vtkm::cont::DynamicArrayHandle(values);
+  }
+};
+
+struct GatherBlockField {
+  ImplicitFieldHandle FieldData;
+  vtkm::Id Start;
+  vtkm::Id NumValues;
+  vtkm::cont::DynamicArrayHandle Values;
+
+  template <typename Device> bool operator()(Device) {
+    this->FieldData.CastAndCall(
+        GatherSlab<Device>(this->Start, this->NumValues, this->Values));
+    return true;
+  }
+};
+
+// Number of input cells that produced output, and of those split into more
+// than one output cell.
+struct SplitStatistics {
+  vtkm::cont::ArrayHandle<vtkm::Id> CellIds;
+  vtkm::cont::ArrayHandle<vtkm::Id> Counts;
+  vtkm::Id Contributing;
+  vtkm::Id Split;
+
+  template <typename Device> bool operator()(Device) {
+    using DeviceAlgorithm = vtkm::cont::DeviceAdapterAlgorithm<Device>;
+    vtkm::cont::ArrayHandleConstant<vtkm::Id> ones(1,
+                                                   this->CellIds.GetNumberOfValues());
+    vtkm::cont::ArrayHandle<vtkm::Id> uniqueCellIds;
+    DeviceAlgorithm::Sort(this->CellIds);
+    DeviceAlgorithm::ReduceByKey(this->CellIds, ones, uniqueCellIds,
+                                 this->Counts, vtkm::Add());
+    this->Contributing = uniqueCellIds.GetNumberOfValues();
+    this->Split = 0;
+    auto counts = this->Counts.GetPortalConstControl();
+    for (vtkm::Id i = 0; i < counts.GetNumberOfValues(); i++)
+      this->Split += (counts.Get(i) > 1) ? 1 : 0;
+    return true;
+  }
+};
+
+// The cell layers along z are spread evenly over the ranks. A block holds the
+// point planes bounding its layers, so neighbours share a plane of points but
+// no cells. Returns false when the rank gets no layer.
+bool extractBlock(const vtkm::cont::DataSet &global, const std::string &variable,
+                  int rank, int numRanks, vtkm::cont::DataSet &block) {
+  vtkm::cont::DynamicCellSet cellSet = global.GetCellSet(0);
+  if (!cellSet.IsSameType(vtkm::cont::CellSetStructured<3>()))
+    throw vtkm::cont::ErrorBadValue("Distributed clipping needs a 3D structured mesh");
+  vtkm::Id3 dims =
+      cellSet.Cast<vtkm::cont::CellSetStructured<3>>().GetPointDimensions();
+  auto coords = global.GetCoordinateSystem().GetData();
+  if (!coords.IsSameType(vtkm::cont::ArrayHandleUniformPointCoordinates()))
+    throw vtkm::cont::ErrorBadValue("Distributed clipping needs uniform coordinates");
+  auto uniform = coords.Cast<vtkm::cont::ArrayHandleUniformPointCoordinates>()
+                     .GetPortalConstControl();
+
+  vtkm::Id layers = dims[2] - 1;
+  vtkm::Id firstLayer = layers * rank / numRanks;
+  vtkm::Id lastLayer = layers * (rank + 1) / numRanks;
+  if (lastLayer == firstLayer)
+    return false;
+
+  vtkm::Id3 blockDims(dims[0], dims[1], lastLayer - firstLayer + 1);
+  vtkm::Vec<vtkm::FloatDefault, 3> origin = uniform.GetOrigin();
+  vtkm::Vec<vtkm::FloatDefault, 3> spacing = uniform.GetSpacing();
+  origin[2] += static_cast<vtkm::FloatDefault>(firstLayer) * spacing[2];
+  block.AddCoordinateSystem(
+      vtkm::cont::CoordinateSystem("coordinates", blockDims, origin, spacing));
+  vtkm::cont::CellSetStructured<3> blockCells("cells");
+  blockCells.SetPointDimensions(blockDims);
+  block.AddCellSet(blockCells);
+
+  GatherBlockField gather;
+  gather.FieldData = GetScalarField(global, variable);
+  gather.Start = firstLayer * dims[0] * dims[1];
+  gather.NumValues = blockDims[0] * blockDims[1] * blockDims[2];
+  vtkm::cont::TryExecute(gather);
+  vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+  datasetFieldAdder.AddPointField(block, variable, gather.Values);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  int rank, numRanks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+  if (argc < 4) {
+    if (rank == 0) {
+      std::cout << "Invalid number of arguments" << std::endl;
+      std::cout << "Usage : " << argv[0] << " <file> <variable> <isovalue>"
+                << " [--pipeline=isovolume|cases] [--phases=N]"
+                << " [--classifier=worklet|packed|simd]"
+                << " [--device=serial|tbb|cuda] [--threads=N]" << std::endl;
+      std::cout << "Every rank reads the whole file before keeping its slab;"
+                << " synthetic:<field>:<dims> inputs only store its slab."
+                << std::endl;
+    }
+    MPI_Finalize();
+    exit(1);
+  }
+
+  const std::string filename(argv[1]);
+  const std::string variable(argv[2]);
+  float isoValue = atof(argv[3]);
+  std::map<std::string, std::string> options;
+  for (int index = 4; index < argc; index++) {
+    std::string arg(argv[index]);
+    if (arg.compare(0, 2, "--") != 0)
+      continue;
+    size_t split = arg.find('=');
+    options[arg.substr(2, split - 2)] =
+        (split == std::string::npos) ? "" : arg.substr(split + 1);
+  }
+  bool cases = options["pipeline"] == "cases";
+  int phases = options.count("phases") ? atoi(options["phases"].c_str()) : 2;
+  std::string classifier =
+      options.count("classifier") ? options["classifier"] : "packed";
+
+  // With several ranks on one box, --threads keeps TBB from oversubscribing.
+  std::string device = SelectDevice(options["device"]);
+#ifdef VTKM_ENABLE_TBB
+  int numThreads = options.count("threads") ? atoi(options["threads"].c_str())
+                                            : tbb::task_scheduler_init::automatic;
+  tbb::task_scheduler_init tbbInit(numThreads);
+  SetHostThreads(numThreads);
+#endif
+  if (rank == 0)
+    std::cout << "Running " << (cases ? "case extraction" : "isovolume")
+              << " on " << numRanks << " ranks, device : " << device
+              << std::endl;
+
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> loadTimer;
+  vtkm::cont::DataSet block;
+  bool haveBlock;
+  {
+    vtkm::cont::DataSet global = LoadDataSet(filename, variable);
+    haveBlock = extractBlock(global, variable, rank, numRanks, block);
+  }
+  vtkm::Float64 loadTime = loadTimer.GetElapsedTime();
+
+  // Counts : input cells, output cells, contributing cells, split cells, and
+  // the input cells of the five case extraction buckets.
+  const int numCounts = 9;
+  long long localCounts[numCounts] = {0};
+  // Times : load, threshold, clip, total.
+  const int numTimes = 4;
+  vtkm::Float64 localTimes[numTimes] = {loadTime, 0, 0, 0};
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> totalTimer;
+  if (haveBlock) {
+    localCounts[0] = block.GetCellSet(0).GetNumberOfCells();
+    const std::string cellIdsVar("cellIds");
+    vtkm::cont::DataSetFieldAdd datasetFieldAdder;
+    datasetFieldAdder.AddCellField(block, cellIdsVar,
+                                   vtkm::cont::ArrayHandleIndex(localCounts[0]));
+
+    std::vector<vtkm::cont::DataSet> dataOut;
+    if (cases) {
+      std::vector<vtkm::cont::DataSet> dataIn;
+      CaseExtractionTimes times =
+          ExtractCasesAndClip(block, variable, isoValue, phases, dataIn,
+                              dataOut, classifier, false, cellIdsVar);
+      localTimes[1] = times.Threshold;
+      localTimes[2] = times.Clip;
+      for (size_t i = 0; i < dataIn.size(); i++)
+        localCounts[4 + i] = dataIn[i].GetCellSet(0).GetNumberOfCells();
+    } else {
+      vtkm::cont::Timer<VTKM_DEFAULT_DEVICE_ADAPTER_TAG> clipTimer;
+      ImplicitFieldPolicy policy;
+      vtkm::filter::ClipWithField clip;
+      clip.SetClipValue(isoValue);
+      vtkm::filter::Result result = clip.Execute(block, variable, policy);
+      clip.MapFieldOntoOutput(result, block.GetCellField(cellIdsVar), policy);
+      localTimes[2] = clipTimer.GetElapsedTime();
+      dataOut.assign(1, result.GetDataSet());
+    }
+
+    // The cell ids of all the outputs in one array, so that the statistics
+    // are those of the whole block whichever pipeline split it.
+    std::vector<vtkm::Id> cellIds;
+    for (const vtkm::cont::DataSet &output : dataOut) {
+      vtkm::Id numCells = output.GetCellSet(0).GetNumberOfCells();
+      localCounts[1] += numCells;
+      if (numCells == 0)
+        continue;
+      vtkm::cont::ArrayHandle<vtkm::Id> outputIds;
+      output.GetCellField(cellIdsVar).GetData().CopyTo(outputIds);
+      auto portal = outputIds.GetPortalConstControl();
+      for (vtkm::Id i = 0; i < portal.GetNumberOfValues(); i++)
+        cellIds.push_back(portal.Get(i));
+    }
+    if (!cellIds.empty()) {
+      SplitStatistics stats;
+      stats.CellIds = vtkm::cont::make_ArrayHandle(cellIds);
+      vtkm::cont::TryExecute(stats);
+      localCounts[2] = stats.Contributing;
+      localCounts[3] = stats.Split;
+    }
+  }
+  localTimes[3] = totalTimer.GetElapsedTime();
+
+  long long globalCounts[numCounts];
+  vtkm::Float64 minTimes[numTimes], maxTimes[numTimes], sumTimes[numTimes];
+  MPI_Reduce(localCounts, globalCounts, numCounts, MPI_LONG_LONG, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(localTimes, minTimes, numTimes, MPI_DOUBLE, MPI_MIN, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(localTimes, maxTimes, numTimes, MPI_DOUBLE, MPI_MAX, 0,
+             MPI_COMM_WORLD);
+  MPI_Reduce(localTimes, sumTimes, numTimes, MPI_DOUBLE, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    std::cout << "Input Cells : " << globalCounts[0] << std::endl;
+    std::cout << "Output Cells : " << globalCounts[1] << std::endl;
+    std::cout << "Input cells in output : " << globalCounts[2] << std::endl;
+    std::cout << "Input cells split : " << globalCounts[3] << std::endl;
+    if (cases) {
+      const char *buckets[] = {"7-12 edges", "5-6 edges", "4 edges",
+                               "3 edges", "inside"};
+      for (int i = 0; i < 5; i++)
+        std::cout << "Bucket " << buckets[i] << " cells : "
+                  << globalCounts[4 + i] << std::endl;
+    }
+    const char *stages[] = {"load", "threshold", "clip", "total"};
+    for (int i = 0; i < numTimes; i++) {
+      if (i == 1 && !cases)
+        continue;
+      std::cout << "Time taken for " << stages[i] << " (min / avg / max) : "
+                << minTimes[i] << " / " << sumTimes[i] / numRanks << " / "
+                << maxTimes[i] << std::endl;
+    }
+    std::cout << "Load imbalance (max / avg) : "
+              << maxTimes[3] / (sumTimes[3] / numRanks) << std::endl;
+    std::cout << "Throughput : " << globalCounts[0] / maxTimes[3] << " cells/s"
+              << std::endl;
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -3,6 +3,7 @@
 #include <functional>
 #include <future>
 #include <iostream>
+#include <map>
 #include <set>
 #include <vector>
 
@@ -10,27 +11,28 @@
 #include <vtkm/cont/DataSetFieldAdd.h>
 #include <vtkm/cont/Timer.h>
 #include <vtkm/filter/ClipWithField.h>
-#include <vtkm/filter/FieldSelection.h>
-#include <vtkm/io/reader/VTKDataSetReader.h>
 #include <vtkm/worklet/DispatcherMapField.h>
 #include <vtkm/worklet/DispatcherMapTopology.h>
 #include <vtkm/worklet/WorkletMapField.h>
 #include <vtkm/worklet/WorkletMapTopology.h>
 
+#include "DeviceSelection.h"
+#include "SyntheticDataSet.h"
+
 bool performTrivialIsoVolume(vtkm::cont::DataSet &input,
                              const std::string variable,
                              const vtkm::Float32 isoVal,
                              vtkm::cont::DataSet &output) {
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
   vtkm::filter::Result result;
   vtkm::filter::ClipWithField filter;
   // Apply clip isoVal.
   filter.SetClipValue(isoVal);
   filter.SetActiveField(variable);
 
-  result = filter.Execute(input, vtkm::filter::FieldSelection({variable}));
+  // The policy lets the filter read procedural fields as well as stored ones.
+  ImplicitFieldPolicy policy;
+  result = filter.Execute(input, variable, policy);
+  filter.MapFieldOntoOutput(result, input.GetPointField(variable), policy);
 
   // Output of clip.
   output = result.GetDataSet();
@@ -40,22 +42,32 @@ bool performTrivialIsoVolume(vtkm::cont::DataSet &input,
 int main(int argc, char **argv) {
   if (argc < 4) {
     std::cout << "Invalid number of arguments" << std::endl;
+    std::cout << "Usage : " << argv[0] << " <file> <variable> <isovalue>"
+              << " [--device=serial|tbb|cuda]" << std::endl;
     exit(1);
   }
-  using DeviceAdapterTag = VTKM_DEFAULT_DEVICE_ADAPTER_TAG;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
 
   const std::string filename(argv[1]);
   const std::string variable(argv[2]);
   float isoValue = atof(argv[3]);
+  std::map<std::string, std::string> options;
+  for (int index = 4; index < argc; index++) {
+    std::string arg(argv[index]);
+    if (arg.compare(0, 2, "--") != 0)
+      continue;
+    size_t split = arg.find('=');
+    options[arg.substr(2, split - 2)] =
+        (split == std::string::npos) ? "" : arg.substr(split + 1);
+  }
+  std::string device = SelectDevice(options["device"]);
+  std::cout << "Running on device : " << device << std::endl;
   std::cout << "Analyzing cases for " << filename << " on variable " << variable
             << " for isovalue " << isoValue << std::endl;
 
-  vtkm::io::reader::VTKDataSetReader reader(filename.c_str());
-  vtkm::cont::DataSet dataset = reader.ReadDataSet();
+  // Either a VTK file or a synthetic:<field>:<dims> spec.
+  vtkm::cont::DataSet dataset = LoadDataSet(filename, variable);
 
-  int numOfCells = dataset.GetCellSet(0).GetNumberOfCells();
+  vtkm::Id numOfCells = dataset.GetCellSet(0).GetNumberOfCells();
   std::cout << "Number of CellSets : " << dataset.GetNumberOfCellSets()
             << std::endl;
   std::cout << "Number of cells " << dataset.GetCellSet(0).GetNumberOfCells()
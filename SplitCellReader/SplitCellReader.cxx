@@ -6,11 +6,15 @@
 #include <vtkm/cont/DataSet.h>
 #include <vtkm/io/reader/VTKDataSetReader.h>
 
-int parseFileForVisIt(char *filename) {
-  using DeviceAdapterTag = vtkm::cont::DeviceAdapterTagSerial;
-  using DeviceAlgorithm =
-      typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
+#include "SharedMemoryDataSet.h"
+
+using DeviceAdapterTag = vtkm::cont::DeviceAdapterTagSerial;
+using DeviceAlgorithm =
+    typename vtkm::cont::DeviceAdapterAlgorithm<DeviceAdapterTag>;
 
+int writeSplitStatistics(vtkm::cont::ArrayHandle<vtkm::Id> fieldDataHandle);
+
+int parseFileForVisIt(char *filename) {
   // Get the File
   // look for avtOriginalCellNumbers
   // Parse ignoring 0s and processing all other numbers
@@ -39,6 +43,51 @@ int parseFileForVisIt(char *filename) {
 
   vtkm::cont::ArrayHandle<vtkm::Id> fieldDataHandle =
       vtkm::cont::make_ArrayHandle(fieldData);
+  return writeSplitStatistics(fieldDataHandle);
+}
+
+// Reads the original cell ids of a clip output exported to shared memory by
+// clippingfilter --shm=<name>, without going through a file. The ids are in
+// avtOriginalCellNumbers when VisIt wrote them (the cell id is the second
+// component), in cellIds when VTK-m did. The segment is removed afterwards
+// unless keep is set.
+struct CopyCellIds {
+  vtkm::cont::ArrayHandle<vtkm::Id> &CellIds;
+
+  template <typename T, typename Storage>
+  void operator()(const vtkm::cont::ArrayHandle<T, Storage> &values) const {
+    using Traits = vtkm::VecTraits<T>;
+    auto portal = values.GetPortalConstControl();
+    this->CellIds.Allocate(values.GetNumberOfValues());
+    auto cellIds = this->CellIds.GetPortalControl();
+    for (vtkm::Id i = 0; i < values.GetNumberOfValues(); i++)
+      cellIds.Set(i, static_cast<vtkm::Id>(Traits::GetComponent(
+                         portal.Get(i), Traits::NUM_COMPONENTS - 1)));
+  }
+};
+
+int parseSharedDataSet(const std::string &name, bool keep) {
+  vtkm::cont::ArrayHandle<vtkm::Id> fieldDataHandle;
+  {
+    SharedDataSet shared(name);
+    vtkm::cont::DataSet dataset = shared.GetDataSet();
+    std::cout << "Attached to " << name << " with "
+              << dataset.GetCellSet(0).GetNumberOfCells() << " cells"
+              << std::endl;
+    std::string fieldName =
+        shared.FindEntry(SHARED_CELL_FIELD, "avtOriginalCellNumbers")
+            ? "avtOriginalCellNumbers"
+            : "cellIds";
+    // The statistics sort the ids, so they get their own copy.
+    dataset.GetCellField(fieldName).GetData().CastAndCall(
+        CopyCellIds{fieldDataHandle});
+  }
+  if (!keep)
+    RemoveSharedDataSet(name);
+  return writeSplitStatistics(fieldDataHandle);
+}
+
+int writeSplitStatistics(vtkm::cont::ArrayHandle<vtkm::Id> fieldDataHandle) {
   // Array with al 1s to get count when reduced by key.
   vtkm::Id numCellIds = fieldDataHandle.GetNumberOfValues();
   vtkm::cont::ArrayHandleConstant<vtkm::Id> toReduce(1, numCellIds);
@@ -83,6 +132,7 @@ int parseFileForVisIt(char *filename) {
   for(int i = 0; i < uniqueKeys; i++)
     visitfile << splitCountPortal.Get(i) << ", " << likeCountPortal.Get(i) << std::endl;
   visitfile.close();
+  return 0;
 }
 
 int main(int argc, char **argv) {
@@ -92,6 +142,12 @@ int main(int argc, char **argv) {
   }
   char *filename = argv[1];
   std::cout << "Calculating the number of Cell Splits" << std::endl;
+  // shm:<name> reads a clip output from shared memory, --keep leaves the
+  // segment in place for further readers.
+  std::string source(filename);
+  if (source.compare(0, 4, "shm:") == 0)
+    return parseSharedDataSet(source.substr(4),
+                              argc > 2 && std::string(argv[2]) == "--keep");
   vtkm::io::reader::VTKDataSetReader reader(filename);
   vtkm::cont::DataSet input = reader.ReadDataSet();
   //processForSplitCells(input);
@@ -1,5 +1,13 @@
 import sys
 
+# VisIt's CLI cannot hand the arrays of a plot to another process, so its side
+# of the comparison still goes through ExportDatabase and a VTK file; only the
+# VTK-m side reads shared memory (shmdataset.py). With --shm the file is
+# written to /dev/shm, which keeps it off the disk but is still parsed.
+useShm = "--shm" in sys.argv
+if useShm :
+  sys.argv.remove("--shm")
+
 numArgs = len(sys.argv)
 if(numArgs < 3) :
   print "Invalid number of arguments"
@@ -37,6 +45,8 @@ DrawPlots()
 ExportDBAtts = ExportDBAttributes()
 ExportDBAtts.allTimes = 0
 ExportDBAtts.filename = "worked_db"
+if useShm :
+  ExportDBAtts.dirname = "/dev/shm"
 ExportDBAtts.timeStateFormat = "_%04d"
 ExportDBAtts.db_type = "VTK"
 ExportDBAtts.db_type_fullname = "VTK_1.0"
@@ -0,0 +1,84 @@
+from __future__ import print_function
+import array, mmap, os, struct, sys
+
+# Reader for the clip outputs that clippingfilter --shm=<name> leaves in
+# /dev/shm/<name> (layout in Common/SharedMemoryDataSet.h). The arrays are
+# returned as views on the mapping when numpy is available, so nothing is
+# copied, and as copies in array.array otherwise, which Python 2 (VisIt's
+# CLI) supports as well. Run on its own it prints the arrays of a segment and
+# the split cell statistics of its cell ids:
+#
+#   python shmdataset.py <name> [--keep]
+
+HEADER = struct.Struct("=8sIIQ")
+ENTRY = struct.Struct("=64sIIIIQQ")
+ROLES = ["coordinates", "shapes", "numindices", "connectivity", "offsets",
+         "point field", "cell field"]
+# Python 2's array module has no "q"; its "l" is 64 bits on Linux.
+INT64 = "q" if "q" in getattr(array, "typecodes", "") else "l"
+TYPES = [("f", 4), ("d", 8), ("i", 4), (INT64, 8), ("B", 1)]
+NUMPY_TYPES = ["float32", "float64", "int32", "int64", "uint8"]
+
+def attach(name):
+  path = os.path.join("/dev/shm", name.lstrip("/"))
+  with open(path, "rb") as segment:
+    mapping = mmap.mmap(segment.fileno(), 0, access=mmap.ACCESS_READ)
+  if len(mapping) < HEADER.size:
+    raise ValueError("%s is not a VTK-m dataset segment" % path)
+  magic, version, numArrays, totalBytes = HEADER.unpack_from(mapping, 0)
+  if (magic != b"VTKMSHM1" or version != 1 or totalBytes > len(mapping) or
+      HEADER.size + numArrays * ENTRY.size > totalBytes):
+    raise ValueError("%s is not a VTK-m dataset segment" % path)
+  try:
+    import numpy
+  except ImportError:
+    numpy = None
+  arrays = []
+  for i in range(numArrays):
+    fields = ENTRY.unpack_from(mapping, HEADER.size + i * ENTRY.size)
+    name = fields[0].split(b"\0", 1)[0].decode()
+    role, valueType, numComponents, _, numValues, offset = fields[1:]
+    if (role >= len(ROLES) or valueType >= len(TYPES) or
+        not 1 <= numComponents <= 3):
+      raise ValueError("%s has an invalid entry for %s" % (path, name))
+    code, size = TYPES[valueType]
+    count = numValues * numComponents
+    if offset + count * size > totalBytes:
+      raise ValueError("%s is truncated at %s" % (path, name))
+    if numpy is not None:
+      values = numpy.frombuffer(mapping, dtype=NUMPY_TYPES[valueType],
+                                count=count, offset=offset)
+      if numComponents > 1:
+        values = values.reshape(numValues, numComponents)
+    else:
+      values = array.array(code, mapping[offset:offset + count * size])
+    arrays.append((name, ROLES[role], numValues, numComponents, values))
+  return mapping, arrays
+
+def cell_ids(arrays):
+  for wanted in ("avtOriginalCellNumbers", "cellIds"):
+    for name, role, numValues, numComponents, values in arrays:
+      if name == wanted and role == "cell field":
+        # VisIt stores (domain, cell) pairs.
+        return [int(values[i * numComponents + numComponents - 1])
+                if not hasattr(values, "ndim") or values.ndim == 1
+                else int(values[i][-1]) for i in range(numValues)]
+  return None
+
+if __name__ == "__main__":
+  if len(sys.argv) < 2:
+    print("Usage : shmdataset.py <name> [--keep]")
+    sys.exit(1)
+  mapping, arrays = attach(sys.argv[1])
+  for name, role, numValues, numComponents, values in arrays:
+    print("%-24s %-12s %d x %d" % (name, role, numValues, numComponents))
+  ids = cell_ids(arrays)
+  if ids is not None:
+    occurrences = {}
+    for cellId in ids:
+      occurrences[cellId] = occurrences.get(cellId, 0) + 1
+    print("Number of unique Cell IDs : %d" % len(occurrences))
+    print("Number of split Cells : %d" %
+          sum(1 for count in occurrences.values() if count > 1))
+  if "--keep" not in sys.argv:
+    os.unlink(os.path.join("/dev/shm", sys.argv[1].lstrip("/")))